@@ -0,0 +1,94 @@
+#
+# Convert the scheduler trace dumped by bmk_trace_dump (see
+# bmk_trace.subr) into the Chrome trace event format, which can be
+# loaded into chrome://tracing or https://ui.perfetto.dev/
+#
+#	awk -f bmk_trace2json.awk bmk_trace.txt > bmk_trace.json
+#
+# Threads which exited before the dump was taken are named by the
+# address of their thread structure.  The type numbers must match
+# BMK_SCHED_TRACE_* in include/bmk-core/sched.h.
+#
+
+function ev(str) {
+	printf("%s\n%s", sep, str)
+	sep = ","
+}
+
+function us(ns) {
+	return sprintf("%.3f", ns / 1000)
+}
+
+function tid(thr) {
+	if (!(thr in tids)) {
+		tids[thr] = ++ntids
+		ev(sprintf("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1," \
+		    "\"tid\":%d,\"args\":{\"name\":\"%s\"}}", ntids,
+		    (thr in names) ? names[thr] : thr))
+	}
+	return tids[thr]
+}
+
+function name(thr) {
+	return (thr in names) ? names[thr] : thr
+}
+
+function slice(thr, what, start, end, args) {
+	ev(sprintf("{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d," \
+	    "\"ts\":%s,\"dur\":%s%s}", what, tid(thr),
+	    us(start), us(end - start), args))
+}
+
+function instant(thr, what, t, args) {
+	ev(sprintf("{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"pid\":1," \
+	    "\"tid\":%d,\"ts\":%s%s}", what, tid(thr), us(t), args))
+}
+
+BEGIN {
+	SWITCH = 1; WAKE = 2; BLOCK = 3; INTR = 4; INTREND = 5
+	how[0] = "thread"; how[1] = "timeout"; how[2] = "interrupt"
+
+	printf("[")
+	sep = ""
+	ntids = 0
+	intrstart = -1
+}
+
+$1 == "N" {
+	n = $3
+	for (i = 4; i <= NF; i++)
+		n = n " " $i
+	names[$2] = n
+	next
+}
+
+$1 == "T" {
+	t = $2; type = $3; arg = $4; a = $5; b = $6
+	last = t
+
+	if (type == SWITCH) {
+		if (a in running) {
+			slice(a, "running", running[a], t, "")
+			delete running[a]
+		}
+		running[b] = t
+	} else if (type == WAKE) {
+		instant(b, "wakeup", t, sprintf(",\"args\":{\"by\":\"%s\"," \
+		    "\"how\":\"%s\"}", name(a), how[arg]))
+	} else if (type == BLOCK) {
+		instant(a, "block", t, sprintf(",\"args\":{\"timeout\":%s}",
+		    arg ? us(b) : "null"))
+	} else if (type == INTR) {
+		intrstart = t
+		intrarg = arg
+	} else if (type == INTREND && intrstart >= 0) {
+		slice("interrupts", "intr " intrarg, intrstart, t, "")
+		intrstart = -1
+	}
+}
+
+END {
+	for (thr in running)
+		slice(thr, "running", running[thr], last, "")
+	printf("\n]\n")
+}
@@ -32,6 +32,9 @@
 
 int bmk_core_init(unsigned long);
 
+void bmk_core_bootphase(const char *);
+int bmk_core_getbootphase(int, const char **, bmk_time_t *);
+
 #define bmk_assert(x)							\
   do {									\
 	if (__builtin_expect(!(x), 0)) {				\
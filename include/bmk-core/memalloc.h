@@ -78,6 +78,8 @@ void *  bmk_memrealloc_user(void *, unsigned long);
 
 void *  bmk_xmalloc_bmk(unsigned long);
 
+unsigned long bmk_memalloc_inuse(enum bmk_memwho);
+
 /* diagnostic */
 void	bmk_memalloc_printstats(void);
 
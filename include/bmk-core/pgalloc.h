@@ -32,6 +32,11 @@ void *		bmk_pgalloc(int);
 void *		bmk_pgalloc_align(int, unsigned long);
 void		bmk_pgfree(void *, int);
 
+void *		bmk_pgalloc_pages(unsigned long);
+void		bmk_pgfree_pages(void *, unsigned long);
+
+void		bmk_pgalloc_usage(unsigned long *, unsigned long *,
+			    unsigned long *);
 void		bmk_pgalloc_dumpstats(void);
 
 #define bmk_pgalloc_one() bmk_pgalloc(0)
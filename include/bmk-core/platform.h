@@ -37,7 +37,32 @@ void		bmk_platform_cpu_block(bmk_time_t);
 bmk_time_t	bmk_platform_cpu_clock_monotonic(void);
 bmk_time_t	bmk_platform_cpu_clock_epochoffset(void);
 
+/*
+ * A free-running cycle counter which is cheap to read, e.g. the TSC.
+ * bmk_platform_cpu_counter_freq() returns its frequency in Hz, or 0
+ * if the platform has no counter which is safe to use directly.
+ */
+uint64_t	bmk_platform_cpu_counter(void);
+uint64_t	bmk_platform_cpu_counter_freq(void);
+
+/*
+ * Wait at a point where the hypervisor can save the image, and return
+ * once it has been resumed, possibly much later and from a copy.
+ * Returns 0 on resume, or an error if the platform can't do this.
+ */
+int		bmk_platform_snapshot(void);
+
 unsigned long	bmk_platform_splhigh(void);
 void		bmk_platform_splx(unsigned long);
 
+/*
+ * Fill the buffer from the hardware entropy sources of the platform.
+ * Returns the number of bytes written, which is less than requested
+ * (possibly 0) if the sources cannot provide more.
+ */
+unsigned long	bmk_platform_getentropy(void *, unsigned long);
+
+/* same for the cpu, e.g. RDSEED/RDRAND on x86 */
+unsigned long	bmk_cpu_getentropy(void *, unsigned long);
+
 #endif /* _BMK_CORE_PLATFORM_H_ */
@@ -27,6 +27,10 @@
 #define _BMK_CORE_PRINTF_H_
 
 void	bmk_printf_init(void (*)(int), void (*)(void));
+void	bmk_printf_setwrite(void (*)(const char *, unsigned long));
+void	bmk_printf_startflusher(void);
+void	bmk_printf_flush(void);
+void	bmk_printf_putc(int);
 void	bmk_printf(const char *, ...)
 	__attribute__((__format__(__printf__,1,2)));
 int	bmk_snprintf(char *, unsigned long, const char *, ...)
@@ -45,6 +45,38 @@ void	bmk_sched_startmain(void (*)(void *), void *) __attribute__((noreturn));
 void	bmk_sched_yield(void);
 
 void	bmk_sched_dumpqueue(void);
+void	bmk_sched_dumpstacks(void);
+
+#define BMK_SCHED_RUNDELAY_BUCKETS 16
+struct bmk_sched_stats {
+	bmk_time_t bss_runtime;		/* nanoseconds spent running	*/
+	unsigned long bss_nswitch;	/* times switched to		*/
+	unsigned long bss_wakeups;	/* woken up by a thread or intr	*/
+	unsigned long bss_timeouts;	/* woken up by a timeout	*/
+	/* time spent on runq, bucket n counts waits < 2^n us */
+	unsigned long bss_rundelay[BMK_SCHED_RUNDELAY_BUCKETS];
+};
+void	bmk_sched_getstats(struct bmk_thread *, struct bmk_sched_stats *);
+void	bmk_sched_getprocstats(struct bmk_sched_stats *, bmk_time_t *);
+void	bmk_sched_dumpstats(void);
+
+/*
+ * Scheduler event trace types.  tr_a and tr_b are thread pointers
+ * unless noted otherwise.
+ */
+#define BMK_SCHED_TRACE_SWITCH	1	/* a: prev, b: next		*/
+#define BMK_SCHED_TRACE_WAKE	2	/* a: waker, b: wakee, arg: how	*/
+#define BMK_SCHED_TRACE_BLOCK	3	/* a: thread, b: deadline,	*/
+					/* arg: has deadline		*/
+#define BMK_SCHED_TRACE_INTR	4	/* arg: platform irq identifier	*/
+#define BMK_SCHED_TRACE_INTREND	5	/* arg: platform irq identifier	*/
+
+#define BMK_SCHED_TRACE_WAKE_THREAD	0
+#define BMK_SCHED_TRACE_WAKE_TIMEOUT	1
+#define BMK_SCHED_TRACE_WAKE_INTR	2
+
+void	bmk_sched_trace_enable(int);
+void	bmk_sched_trace_intr(unsigned int, int);
 
 struct bmk_thread *bmk_sched_create(const char *, void *, int,
 				    void (*)(void *), void *,
@@ -77,7 +109,27 @@ void	bmk_cpu_sched_create(struct bmk_thread *, struct bmk_tcb *,
 			     void (*)(void *), void *,
 			     void *, unsigned long);
 
+/*
+ * Thread priorities.  The runnable thread with the highest priority
+ * runs next, threads of equal priority run round-robin.  Scheduling
+ * is not preemptive, so a priority only decides who runs at the next
+ * context switch.  The range from BMK_SCHED_PRI_RT up is meant for
+ * latency-sensitive threads, BMK_SCHED_PRI_INTR for the threads which
+ * deliver interrupts.
+ */
+#define BMK_SCHED_NPRI		32
+#define BMK_SCHED_PRI_MIN	0
+#define BMK_SCHED_PRI_DEFAULT	8
+#define BMK_SCHED_PRI_RT	16
+#define BMK_SCHED_PRI_INTR	(BMK_SCHED_NPRI-1)
+#define BMK_SCHED_PRI_MAX	(BMK_SCHED_NPRI-1)
+
+void	bmk_sched_setpri(struct bmk_thread *, int);
+int	bmk_sched_getpri(struct bmk_thread *);
+
 void	bmk_sched_set_hook(void (*)(void *, void *));
+void	bmk_sched_set_stackguard(void (*)(void *, int));
+const char *bmk_sched_stackoverflow(void *);
 struct bmk_thread *bmk_sched_init_mainlwp(void *);
 
 extern __thread struct bmk_thread *bmk_current;
@@ -88,6 +140,11 @@ const char 	*bmk_sched_threadname(struct bmk_thread *);
 void	bmk_cpu_sched_bouncer(void);
 void	bmk_cpu_sched_switch(void *, void *);
 
+#if defined(__i386__) || defined(__x86_64__)
+/* set by the platform once the AVX register state has been enabled */
+extern int bmk_cpu_x86_avx;
+#endif
+
 void	bmk_platform_cpu_sched_settls(struct bmk_tcb *);
 
 #endif /* _BMK_CORE_SCHED_H_ */
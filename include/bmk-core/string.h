@@ -26,6 +26,8 @@
 #ifndef _BMK_CORE_STRING_H_
 #define _BMK_CORE_STRING_H_
 
+void bmk_string_init(void);
+
 void *bmk_memcpy(void *, const void *, unsigned long);
 void *bmk_memset(void *, int, unsigned long);
 void *bmk_memchr(const void *, int, unsigned long);
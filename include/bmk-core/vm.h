@@ -0,0 +1,74 @@
+/*-
+ * Copyright (c) 2026 The rumprun contributors.  All Rights Reserved.
+ *
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _BMK_CORE_VM_H_
+#define _BMK_CORE_VM_H_
+
+/*
+ * Demand paging.  A platform which can resolve page faults in the
+ * context of the faulting thread registers its page table operations
+ * and a window of otherwise unused virtual address space with
+ * bmk_vm_init().  On other platforms bmk_vm_reserve() fails, and
+ * callers are expected to fall back to allocating memory up front.
+ */
+
+struct bmk_vmops {
+	/* map page at va, returns 0 or BMK_ENOMEM */
+	int	(*vmo_map)(unsigned long va, void *page, int writable);
+	void	(*vmo_unmap)(unsigned long va);
+	/* returns the dirty state of va and clears it if requested */
+	int	(*vmo_dirty)(unsigned long va, int clear);
+};
+
+void	bmk_vm_init(const struct bmk_vmops *, unsigned long, unsigned long);
+
+/* called with the faulting address and whether the access was a write */
+typedef int (*bmk_vm_pager_fn)(void *, unsigned long, int);
+
+void	*bmk_vm_reserve(unsigned long, bmk_vm_pager_fn, void *);
+void	bmk_vm_release(void *);
+
+int	bmk_vm_map(void *, void *, int);
+void	bmk_vm_unmap(void *);
+int	bmk_vm_dirty(void *, int);
+
+/* pager for faults in the window outside of any reserved range */
+void	bmk_vm_setdefpager(bmk_vm_pager_fn, void *);
+
+/*
+ * Terminate the program running in the current thread after an
+ * access which cannot be satisfied.  Returns if no handler has been
+ * set, in which case the pager fails the fault.
+ */
+typedef void (*bmk_vm_segv_fn)(unsigned long, int);
+void	bmk_vm_setsegv(bmk_vm_segv_fn);
+void	bmk_vm_segv(unsigned long, int);
+
+/* for the platform */
+int	bmk_vm_inwindow(unsigned long);
+int	bmk_vm_fault(unsigned long, int);
+
+#endif /* _BMK_CORE_VM_H_ */
@@ -32,6 +32,11 @@ int rumprun_platform_rumpuser_init(void);
 
 extern struct rumpuser_hyperup rumpuser__hyp;
 
+void rumpuser_lockstat_dump(void);
+void rumpuser_lockstat_reset(void);
+
+void rumpuser_random_reseed(void);
+
 static inline void
 rumpkern_unsched(int *nlocks, void *interlock)
 {
@@ -32,6 +32,7 @@
 #define RUMPRUN_DEFAULTUSERSTACK ((32*(sizeof(void *)/4)*4096)/1024)
 
 void	rumprun_config(char *);
+void	rumprun_config_netwait(void);
 
 #define RUMPRUN_EXEC_BACKGROUND 0x01
 #define RUMPRUN_EXEC_PIPE	0x02
@@ -42,4 +42,20 @@ void	rumprun_daemon(void);
 
 extern int rumprun_cold;
 
+/*
+ * Scheduler statistics for a thread, as returned by
+ * rumprun_lwp_getstats() for the lwp id from _lwp_self().
+ * rls_rundelay[0] counts runqueue waits under 1us, rls_rundelay[n]
+ * waits of [2^(n-1), 2^n) us, the last entry also all longer waits.
+ */
+#define RUMPRUN_RUNDELAY_BUCKETS 16
+struct rumprun_lwpstats {
+	long long rls_runtime;		/* nanoseconds spent running	*/
+	unsigned long rls_nswitch;	/* times switched to		*/
+	unsigned long rls_wakeups;	/* woken up by a thread or intr	*/
+	unsigned long rls_timeouts;	/* woken up by a timeout	*/
+	unsigned long rls_rundelay[RUMPRUN_RUNDELAY_BUCKETS];
+};
+int	rumprun_lwp_getstats(int, struct rumprun_lwpstats *);
+
 #endif /* _RUMPRUN_BASE_RUMPRUN_H_ */
@@ -0,0 +1,119 @@
+/*-
+ * Copyright (c) 2026 The rumprun contributors.  All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Entropy from the RDSEED and RDRAND instructions.  RDSEED output
+ * comes straight from the hardware entropy source and is preferred
+ * for seeding, RDRAND is the output of a DRBG reseeded from the same
+ * source and is used when RDSEED is not available or runs dry.
+ */
+
+#include <bmk-core/core.h>
+#include <bmk-core/platform.h>
+#include <bmk-core/string.h>
+
+#define CPUID2_RDRAND		0x40000000	/* leaf 1, %ecx */
+#define CPUID_SEFF_RDSEED	0x00040000	/* leaf 7, %ebx */
+
+/* retry counts as recommended by Intel */
+#define RDRAND_RETRIES		10
+#define RDSEED_RETRIES		100
+
+static int probed, haverdrand, haverdseed;
+
+static void
+cpuid(unsigned int leaf, unsigned int *regs)
+{
+
+	__asm__ __volatile__("cpuid"
+	    : "=a"(regs[0]), "=b"(regs[1]), "=c"(regs[2]), "=d"(regs[3])
+	    : "0"(leaf), "2"(0));
+}
+
+static void
+probe(void)
+{
+	unsigned int regs[4], maxleaf;
+
+	cpuid(0, regs);
+	maxleaf = regs[0];
+	cpuid(1, regs);
+	haverdrand = (regs[2] & CPUID2_RDRAND) != 0;
+	if (maxleaf >= 7) {
+		cpuid(7, regs);
+		haverdseed = (regs[1] & CPUID_SEFF_RDSEED) != 0;
+	}
+	probed = 1;
+}
+
+static int
+rdseed(unsigned long *v)
+{
+	unsigned char ok;
+	int i;
+
+	for (i = 0; i < RDSEED_RETRIES; i++) {
+		__asm__ __volatile__("rdseed %0; setc %1"
+		    : "=r"(*v), "=qm"(ok) :: "cc");
+		if (ok)
+			return 1;
+		__asm__ __volatile__("pause");
+	}
+	return 0;
+}
+
+static int
+rdrand(unsigned long *v)
+{
+	unsigned char ok;
+	int i;
+
+	for (i = 0; i < RDRAND_RETRIES; i++) {
+		__asm__ __volatile__("rdrand %0; setc %1"
+		    : "=r"(*v), "=qm"(ok) :: "cc");
+		if (ok)
+			return 1;
+	}
+	return 0;
+}
+
+unsigned long
+bmk_cpu_getentropy(void *buf, unsigned long len)
+{
+	unsigned char *p = buf;
+	unsigned long v, n, done;
+
+	if (!probed)
+		probe();
+
+	for (done = 0; done < len; done += n) {
+		if (!(haverdseed && rdseed(&v)) && !(haverdrand && rdrand(&v)))
+			break;
+		n = len - done < sizeof(v) ? len - done : sizeof(v);
+		bmk_memcpy(p + done, &v, n);
+	}
+
+	return done;
+}
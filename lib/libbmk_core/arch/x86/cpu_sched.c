@@ -38,6 +38,8 @@
 #include <bmk-core/core.h>
 #include <bmk-core/sched.h>
 
+int bmk_cpu_x86_avx;
+
 static void
 stack_push(void **stackp, unsigned long value)
 {
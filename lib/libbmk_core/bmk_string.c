@@ -24,8 +24,10 @@
  */
 
 /*
- * The assumption is that these won't be used very often,
- * only for the very low-level routines.
+ * These are used by the low-level routines, including some on the
+ * I/O paths (e.g. copying packets on Xen), so the ones which deal
+ * with larger amounts of data work a word at a time.  On x86, "rep
+ * movsb" and "rep stosb" are used if the CPU says they are fast.
  *
  * Some code from public domain implementations.
  */
@@ -33,14 +35,70 @@
 #include <bmk-core/null.h>
 #include <bmk-core/string.h>
 
+typedef unsigned long __attribute__((__may_alias__)) word_t;
+#define WSIZE		sizeof(word_t)
+#define WMASK		(WSIZE-1)
+#define WONES		((word_t)-1 / 0xff)
+#define WHIGHS		(WONES << 7)
+#define HASZERO(w)	(((w) - WONES) & ~(w) & WHIGHS)
+
+#define ALIGNED(p)	(((unsigned long)(p) & WMASK) == 0)
+
+#if defined(__i386__) || defined(__x86_64__)
+#define STRING_REP
+
+/*
+ * Use the string instructions for lengths at or above this.
+ * With ERMS they win for anything except small copies, with FSRM
+ * (fast short rep mov) for everything.  ~0 means never.
+ */
+static unsigned long string_repmin = ~0UL;
+
+#define CPUID7_EBX_ERMS	0x00000200
+#define CPUID7_EDX_FSRM	0x00000010
+
+void
+bmk_string_init(void)
+{
+	unsigned int eax, ebx, ecx, edx;
+
+	__asm__("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx)
+	    : "0"(0));
+	if (eax < 7)
+		return;
+	__asm__("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx)
+	    : "0"(7), "2"(0));
+
+	if (edx & CPUID7_EDX_FSRM)
+		string_repmin = 0;
+	else if (ebx & CPUID7_EBX_ERMS)
+		string_repmin = 256;
+}
+#else
+void
+bmk_string_init(void)
+{
+
+	return;
+}
+#endif
+
 unsigned long
 bmk_strlen(const char *str)
 {
-	unsigned long rv = 0;
+	const char *p = str;
+	const word_t *w;
 
-	while (*str++)
-		rv++;
-	return rv;
+	for (; !ALIGNED(p); p++)
+		if (*p == '\0')
+			return p - str;
+
+	/* an aligned word never crosses a page boundary */
+	for (w = (const word_t *)p; !HASZERO(*w); w++)
+		continue;
+	for (p = (const char *)w; *p; p++)
+		continue;
+	return p - str;
 }
 
 int
@@ -99,7 +157,23 @@ void *
 bmk_memset(void *b, int c, unsigned long n)
 {
 	unsigned char *v = b;
+	word_t fill;
 
+#ifdef STRING_REP
+	if (n >= string_repmin) {
+		__asm__ __volatile__("rep stosb"
+		    : "+D"(v), "+c"(n) : "a"(c) : "memory");
+		return b;
+	}
+#endif
+
+	if (n >= 2*WSIZE) {
+		fill = WONES * (unsigned char)c;
+		for (; !ALIGNED(v); n--)
+			*v++ = (unsigned char)c;
+		for (; n >= WSIZE; n -= WSIZE, v += WSIZE)
+			*(word_t *)v = fill;
+	}
 	while (n--)
 		*v++ = (unsigned char)c;
 
@@ -115,6 +189,22 @@ bmk_memcpy(void *d, const void *src, unsigned long n)
 	dp = d;
 	sp = src;
 
+#ifdef STRING_REP
+	if (n >= string_repmin) {
+		__asm__ __volatile__("rep movsb"
+		    : "+D"(dp), "+S"(sp), "+c"(n) :: "memory");
+		return d;
+	}
+#endif
+
+	/* go word-wide if both pointers can be aligned at the same time */
+	if (n >= 2*WSIZE
+	    && (((unsigned long)dp ^ (unsigned long)sp) & WMASK) == 0) {
+		for (; !ALIGNED(dp); n--)
+			*dp++ = *sp++;
+		for (; n >= WSIZE; n -= WSIZE, dp += WSIZE, sp += WSIZE)
+			*(word_t *)dp = *(const word_t *)sp;
+	}
 	while (n--)
 		*dp++ = *sp++;
 
@@ -125,12 +215,21 @@ void *
 bmk_memchr(const void *d, int c, unsigned long n)
 {
 	const unsigned char *p = d;
+	const word_t *w;
+	word_t mask;
 
-	while (n--) {
+	for (; n && !ALIGNED(p); n--, p++)
+		if (*p == (unsigned char)c)
+			return (void *)(unsigned long)p;
+
+	mask = WONES * (unsigned char)c;
+	for (w = (const word_t *)p; n >= WSIZE; n -= WSIZE, w++)
+		if (HASZERO(*w ^ mask))
+			break;
+
+	for (p = (const unsigned char *)w; n--; p++)
 		if (*p == (unsigned char)c)
 			return (void *)(unsigned long)p;
-		p++;
-	}
 	return NULL;
 }
 
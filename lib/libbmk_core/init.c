@@ -25,6 +25,7 @@
 
 #include <bmk-core/core.h>
 #include <bmk-core/memalloc.h>
+#include <bmk-core/string.h>
 
 #include <bmk-pcpu/pcpu.h>
 
@@ -40,7 +41,42 @@ bmk_core_init(unsigned long stackpageorder)
 	bmk_stackpageorder = stackpageorder;
 	bmk_stacksize = (1<<stackpageorder) * BMK_PCPU_PAGE_SIZE;
 
+	bmk_string_init();
 	bmk_memalloc_init();
 
 	return 0;
 }
+
+/*
+ * Timestamps of boot phases, in monotonic time, i.e. since the platform
+ * clock was started.  Phase names are not copied, so they must be
+ * string constants.
+ */
+#define BOOTPHASE_MAX 16
+static struct {
+	const char *bp_name;
+	bmk_time_t bp_time;
+} bootphases[BOOTPHASE_MAX];
+static int nbootphases;
+
+void
+bmk_core_bootphase(const char *name)
+{
+
+	if (nbootphases == BOOTPHASE_MAX)
+		return;
+	bootphases[nbootphases].bp_name = name;
+	bootphases[nbootphases].bp_time = bmk_platform_cpu_clock_monotonic();
+	nbootphases++;
+}
+
+int
+bmk_core_getbootphase(int which, const char **name, bmk_time_t *time)
+{
+
+	if (which < 0 || which >= nbootphases)
+		return 0;
+	*name = bootphases[which].bp_name;
+	*time = bootphases[which].bp_time;
+	return 1;
+}
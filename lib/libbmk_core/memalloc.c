@@ -86,6 +86,9 @@ static struct freebucket freebuckets[LOCALBUCKETS];
  */
 static unsigned nmalloc[LOCALBUCKETS];
 
+/* bytes handed out per allocator level, see bmk_memalloc_inuse() */
+static unsigned long inuse[BMK_MEMWHO_USER+1];
+
 /* not multicore */
 #define malloc_lock()
 #define malloc_unlock()
@@ -210,6 +213,7 @@ bmk_memalloc(unsigned long nbytes, unsigned long align, enum bmk_memwho who)
 	hdr->mh_index = bucket;
 	hdr->mh_alignpad = alignpad;
 	hdr->mh_who = who;
+	inuse[who] += 1UL<<(bucket+MINSHIFT);
 
   	return rv;
 }
@@ -268,6 +272,7 @@ bmk_memfree(void *cp, enum bmk_memwho who)
 
 	index = hdr->mh_index;
 	alignpad = hdr->mh_alignpad;
+	inuse[hdr->mh_who] -= 1UL<<(index+MINSHIFT);
 
 	origp = (unsigned char *)cp - alignpad;
 
@@ -338,6 +343,17 @@ bmk_memrealloc_user(void *cp, unsigned long nbytes)
 	return np;
 }
 
+/*
+ * Bytes currently allocated at the given level, including the
+ * rounding up to the bucket size.
+ */
+unsigned long
+bmk_memalloc_inuse(enum bmk_memwho who)
+{
+
+	return inuse[who];
+}
+
 /*
  * mstats - print out statistics about malloc
  * 
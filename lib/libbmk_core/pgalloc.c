@@ -78,7 +78,7 @@ int bmk_pgalloc_debug = 0;
 #define SANITY_CHECK() sanity_check()
 #endif
 
-unsigned long pgalloc_totalkb, pgalloc_usedkb;
+unsigned long pgalloc_totalkb, pgalloc_usedkb, pgalloc_maxusedkb;
 
 /*
  * The allocation bitmap is offset to the first page loaded, which is
@@ -243,6 +243,20 @@ sanity_check(void)
 }
 #endif
 
+/*
+ * Memory managed by the page allocator, and how much of it is in use
+ * now and at most so far, in kB.
+ */
+void
+bmk_pgalloc_usage(unsigned long *totalkb, unsigned long *usedkb,
+	unsigned long *maxusedkb)
+{
+
+	*totalkb = pgalloc_totalkb;
+	*usedkb = pgalloc_usedkb;
+	*maxusedkb = pgalloc_maxusedkb;
+}
+
 void
 bmk_pgalloc_dumpstats(void)
 {
@@ -409,6 +423,8 @@ bmk_pgalloc_align(int order, unsigned long align)
 	DPRINTF(("bmk_pgalloc: allocated 0x%lx bytes at %p\n",
 	    order2size(order), alloc_ch));
 	pgalloc_usedkb += len>>10;
+	if (pgalloc_usedkb > pgalloc_maxusedkb)
+		pgalloc_maxusedkb = pgalloc_usedkb;
 
 #ifdef BMK_PGALLOC_DEBUG
 	{
@@ -485,3 +501,50 @@ bmk_pgfree(void *pointer, int order)
 
 	SANITY_CHECK();
 }
+
+/*
+ * Allocate npgs pages.  The count need not be a power of two: the
+ * pages past npgs in the underlying block are returned to the
+ * freelists right away.  Any page-aligned subrange of the result
+ * may later be freed with bmk_pgfree_pages().
+ */
+void *
+bmk_pgalloc_pages(unsigned long npgs)
+{
+	void *p;
+	int order;
+
+	bmk_assert(npgs > 0);
+
+	for (order = 0; (1UL<<order) < npgs; order++)
+		continue;
+	if ((unsigned)order >= FREELIST_LEVELS)
+		return NULL;
+
+	if ((p = bmk_pgalloc(order)) != NULL && (1UL<<order) != npgs) {
+		bmk_pgfree_pages((char *)p + npgs*BMK_PCPU_PAGE_SIZE,
+		    (1UL<<order) - npgs);
+	}
+	return p;
+}
+
+/*
+ * Free npgs pages starting from pointer, as the largest naturally
+ * aligned blocks that fit so that the buddies can coalesce.
+ */
+void
+bmk_pgfree_pages(void *pointer, unsigned long npgs)
+{
+	unsigned long addr = (unsigned long)pointer;
+	int order;
+
+	while (npgs) {
+		order = __builtin_ctzl(addr) - BMK_PCPU_PAGE_SHIFT;
+		while ((1UL<<order) > npgs)
+			order--;
+
+		bmk_pgfree((void *)addr, order);
+		addr += order2size(order);
+		npgs -= 1UL<<order;
+	}
+}
@@ -64,6 +64,8 @@ unsigned long bmk_mainstacksize;
 #define THR_EXTSTACK	0x0100
 #define THR_DEAD	0x0200
 #define THR_BLOCKPREP	0x0400
+#define THR_FREETLS	0x0800		/* reaper frees tls area	*/
+#define THR_PAINTED	0x1000		/* stack usage can be measured	*/
 
 #if !(defined(__i386__) || defined(__x86_64__))
 #define _TLS_I
@@ -91,11 +93,17 @@ struct bmk_thread {
 
 	int bt_flags;
 	int bt_errno;
+	int bt_pri;
 
 	void *bt_stackbase;
 
 	void *bt_cookie;
 
+	/* accounting, see bmk_sched_getstats() */
+	struct bmk_sched_stats bt_stats;
+	bmk_time_t bt_lastrun;		/* when last switched to	*/
+	bmk_time_t bt_enqtime;		/* when last put on runq	*/
+
 	/* MD thread control block */
 	struct bmk_tcb bt_tcb;
 
@@ -110,7 +118,7 @@ static struct threadqueue zombieq = TAILQ_HEAD_INITIALIZER(zombieq);
 
 /*
  * We have 3 different queues for theoretically runnable threads:
- * 1) runnable threads waiting to be scheduled
+ * 1) runnable threads waiting to be scheduled, one queue per priority
  * 2) threads waiting for a timeout to expire (or to be woken up)
  * 3) threads waiting indefinitely for a wakeup
  *
@@ -122,18 +130,121 @@ static struct threadqueue zombieq = TAILQ_HEAD_INITIALIZER(zombieq);
  *        while a thread is already in the runnable queue or while
  *        running (via interrupt handler) have no effect.
  */
-static struct threadqueue runq = TAILQ_HEAD_INITIALIZER(runq);
+static struct threadqueue runq[BMK_SCHED_NPRI];
+static unsigned int runqbits;	/* bit n set iff runq[n] not empty */
 static struct threadqueue blockq = TAILQ_HEAD_INITIALIZER(blockq);
 static struct threadqueue timeq = TAILQ_HEAD_INITIALIZER(timeq);
 
 static void (*scheduler_hook)(void *, void *);
 
+static bmk_time_t idletime;
+static struct bmk_sched_stats deadstats;	/* sum over reaped threads */
+
 static void
 print_threadinfo(struct bmk_thread *thread)
 {
 
-	bmk_printf("thread \"%s\" at %p, flags 0x%x\n",
-	    thread->bt_name, thread, thread->bt_flags);
+	bmk_printf("thread \"%s\" at %p, flags 0x%x, pri %d\n",
+	    thread->bt_name, thread, thread->bt_flags, thread->bt_pri);
+}
+
+/*
+ * Run queue manipulation.  Must be called at splhigh.  The queue of
+ * a priority level is (re)initialized when it becomes non-empty, so
+ * no separate initialization is needed.
+ */
+static void
+runq_insert(struct bmk_thread *thread)
+{
+	struct threadqueue *rq = &runq[thread->bt_pri];
+
+	if ((runqbits & (1U<<thread->bt_pri)) == 0) {
+		TAILQ_INIT(rq);
+		runqbits |= 1U<<thread->bt_pri;
+	}
+	TAILQ_INSERT_TAIL(rq, thread, bt_schedq);
+}
+
+static void
+runq_remove(struct bmk_thread *thread)
+{
+	struct threadqueue *rq = &runq[thread->bt_pri];
+
+	TAILQ_REMOVE(rq, thread, bt_schedq);
+	if (TAILQ_EMPTY(rq))
+		runqbits &= ~(1U<<thread->bt_pri);
+}
+
+static struct bmk_thread *
+runq_first(void)
+{
+
+	if (runqbits == 0)
+		return NULL;
+	return TAILQ_FIRST(&runq[31 - __builtin_clz(runqbits)]);
+}
+
+/*
+ * Scheduler event trace.  Events are written into a ring of fixed
+ * size records, overwriting the oldest ones.  The ring is meant to be
+ * read with a debugger while the guest is stopped, see
+ * gdbscripts/bmk_trace.subr.  Interrupt handlers may record events,
+ * so a slot is claimed and filled at splhigh.
+ */
+#ifndef BMK_SCHED_TRACE_ENTRIES
+#define BMK_SCHED_TRACE_ENTRIES 2048	/* must be a power of two */
+#endif
+
+struct bmk_sched_tracerec {
+	bmk_time_t tr_time;
+	unsigned long tr_a;
+	unsigned long tr_b;
+	unsigned int tr_type;
+	unsigned int tr_arg;
+};
+struct bmk_sched_tracerec bmk_sched_tracebuf[BMK_SCHED_TRACE_ENTRIES];
+unsigned long bmk_sched_traceidx;
+int bmk_sched_trace_on;
+static int trace_intrdepth;
+
+static void
+trace(unsigned int type, unsigned int arg, void *a, unsigned long b)
+{
+	struct bmk_sched_tracerec *tr;
+	unsigned long flags;
+
+	if (__builtin_expect(!bmk_sched_trace_on, 1))
+		return;
+
+	flags = bmk_platform_splhigh();
+	tr = &bmk_sched_tracebuf[bmk_sched_traceidx++
+	    & (BMK_SCHED_TRACE_ENTRIES-1)];
+	tr->tr_time = bmk_platform_cpu_clock_monotonic();
+	tr->tr_type = type;
+	tr->tr_arg = arg;
+	tr->tr_a = (unsigned long)a;
+	tr->tr_b = b;
+	bmk_platform_splx(flags);
+}
+
+void
+bmk_sched_trace_enable(int on)
+{
+
+	bmk_sched_trace_on = on;
+}
+
+void
+bmk_sched_trace_intr(unsigned int irq, int done)
+{
+
+	if (done) {
+		trace_intrdepth--;
+		trace(BMK_SCHED_TRACE_INTREND, irq, NULL, 0);
+	} else {
+		trace_intrdepth++;
+		trace(BMK_SCHED_TRACE_INTR, irq, NULL, 0);
+	}
 }
 
 static inline void
@@ -179,13 +290,19 @@ set_runnable(struct bmk_thread *thread)
 		bmk_platform_halt("invalid thread queue");
 	}
 
+	if (tflags & THR_TIMEDOUT)
+		thread->bt_stats.bss_timeouts++;
+	else
+		thread->bt_stats.bss_wakeups++;
+
 	/*
 	 * Else, target was blocked and need to make it runnable
 	 */
 	flags = bmk_platform_splhigh();
+	thread->bt_enqtime = bmk_platform_cpu_clock_monotonic();
 	TAILQ_REMOVE(tq, thread, bt_schedq);
 	setflags(thread, THR_RUNQ, THR_QMASK);
-	TAILQ_INSERT_TAIL(&runq, thread, bt_schedq);
+	runq_insert(thread);
 	bmk_platform_splx(flags);
 }
 
@@ -247,29 +364,202 @@ clear_runnable(void)
 	thread->bt_flags = newfl;
 }
 
+/*
+ * Caches for the stacks, thread structures and tls areas of exited
+ * threads, so that creating a thread usually does not have to go to
+ * the page and memory allocators.  At most BMK_SCHED_CACHEMAX of each
+ * are kept.  The free list is linked through the first word.
+ */
+#ifndef BMK_SCHED_CACHEMAX
+#define BMK_SCHED_CACHEMAX 16
+#endif
+
+struct freecache {
+	void *fc_head;
+	unsigned int fc_n;
+};
+static struct freecache stackcache, thrcache, tlscache;
+
+static void *
+cache_get(struct freecache *fc)
+{
+	void **v;
+
+	if ((v = fc->fc_head) != NULL) {
+		fc->fc_head = *v;
+		fc->fc_n--;
+	}
+	return v;
+}
+
+static int
+cache_put(struct freecache *fc, void *v)
+{
+
+	if (fc->fc_n >= BMK_SCHED_CACHEMAX)
+		return 0;
+	*(void **)v = fc->fc_head;
+	fc->fc_head = v;
+	fc->fc_n++;
+	return 1;
+}
+
+/*
+ * Stack guards and usage tracking.  If the platform registered a
+ * routine for (un)mapping pages, the lowest page of every stack we
+ * allocate is made inaccessible so that an overflow faults instead
+ * of silently corrupting whatever lies below.  Stacks are painted
+ * with a known pattern when allocated so that the deepest point
+ * reached can later be determined by scanning for the pattern.
+ *
+ * The stack addresses handed out and stored in bt_stackbase are the
+ * usable ones, i.e. above the guard page.
+ */
+#define STACKPAINT ((unsigned long)0xa5a5a5a5a5a5a5a5ULL)
+
+static void (*stackguard)(void *, int);
+static unsigned long stackguardsize;
+static unsigned long stackmaxused;
+
+static unsigned long
+stackused(void *stack, unsigned long ss)
+{
+	unsigned long *p = stack, *end = (void *)((char *)stack + ss);
+
+	/* the first word is overwritten by the md code / the free list */
+	for (p++; p < end && *p == STACKPAINT; p++)
+		continue;
+	return (unsigned long)((char *)end - (char *)p);
+}
+
+static void
+stackpaint(void *stack, unsigned long ss)
+{
+	unsigned long *p = stack, *end = (void *)((char *)stack + ss);
+
+	while (p < end)
+		*p++ = STACKPAINT;
+}
+
 static void
 stackalloc(void **stack, unsigned long *ss)
 {
+	char *s;
 
-	*stack = bmk_pgalloc(bmk_stackpageorder);
-	*ss = bmk_stacksize;
+	*ss = bmk_stacksize - stackguardsize;
+	if ((*stack = cache_get(&stackcache)) != NULL)
+		return;
+
+	if ((s = bmk_pgalloc(bmk_stackpageorder)) == NULL)
+		return;
+	if (stackguardsize)
+		stackguard(s, 1);
+	s += stackguardsize;
+	stackpaint(s, *ss);
+	*stack = s;
 }
 
 static void
 stackfree(struct bmk_thread *thread)
 {
+	char *s = thread->bt_stackbase;
+	unsigned long ss = bmk_stacksize - stackguardsize;
+	unsigned long used;
+
+	used = stackused(s, ss);
+	if (used > stackmaxused)
+		stackmaxused = used;
+
+	if (cache_put(&stackcache, s)) {
+		/* only the part that was used needs repainting */
+		stackpaint(s + ss - used, used);
+		return;
+	}
+
+	s -= stackguardsize;
+	if (stackguardsize)
+		stackguard(s, 0);
+	bmk_pgfree(s, bmk_stackpageorder);
+}
+
+/*
+ * Register the routine which the platform uses to make a page
+ * inaccessible (on != 0) or accessible again.  Must be called before
+ * any threads are created.
+ */
+void
+bmk_sched_set_stackguard(void (*f)(void *, int))
+{
+
+	bmk_assert(TAILQ_EMPTY(&threadq));
+	stackguard = f;
+	if (f != NULL && bmk_stackpageorder > 0)
+		stackguardsize = BMK_PCPU_PAGE_SIZE;
+	else
+		stackguardsize = 0;
+}
+
+/*
+ * Return the name of the thread whose stack guard page contains addr,
+ * or NULL.  Meant to be called from the page fault handler.
+ */
+const char *
+bmk_sched_stackoverflow(void *addr)
+{
+	struct bmk_thread *thr;
+	char *guard;
+
+	if (stackguardsize == 0)
+		return NULL;
+
+	TAILQ_FOREACH(thr, &threadq, bt_threadq) {
+		if ((thr->bt_flags & THR_PAINTED) == 0)
+			continue;
+		guard = (char *)thr->bt_stackbase - stackguardsize;
+		if ((char *)addr >= guard
+		    && (char *)addr < guard + stackguardsize)
+			return thr->bt_name;
+	}
+	return NULL;
+}
 
-	bmk_pgfree(thread->bt_stackbase, bmk_stackpageorder);
+/*
+ * Print the high-water mark of stack usage for every thread.  Use this
+ * for choosing the stack size of an application.
+ */
+void
+bmk_sched_dumpstacks(void)
+{
+	struct bmk_thread *thr;
+	unsigned long ss = bmk_stacksize - stackguardsize;
+
+	bmk_printf("BEGIN stack dump (size %lu, guard %lu)\n",
+	    ss, stackguardsize);
+	TAILQ_FOREACH(thr, &threadq, bt_threadq) {
+		if (thr->bt_flags & THR_PAINTED)
+			bmk_printf("thread \"%s\": %lu used\n",
+			    thr->bt_name, stackused(thr->bt_stackbase, ss));
+		else
+			bmk_printf("thread \"%s\": external stack\n",
+			    thr->bt_name);
+	}
+	bmk_printf("max used by exited threads: %lu\n", stackmaxused);
+	bmk_printf("END stack dump\n");
 }
 
 void
 bmk_sched_dumpqueue(void)
 {
 	struct bmk_thread *thr;
+	int pri;
 
 	bmk_printf("BEGIN runq dump\n");
-	TAILQ_FOREACH(thr, &runq, bt_schedq) {
-		print_threadinfo(thr);
+	for (pri = BMK_SCHED_PRI_MAX; pri >= BMK_SCHED_PRI_MIN; pri--) {
+		if ((runqbits & (1U<<pri)) == 0)
+			continue;
+		TAILQ_FOREACH(thr, &runq[pri], bt_schedq) {
+			print_threadinfo(thr);
+		}
 	}
 	bmk_printf("END runq dump\n");
 
@@ -286,6 +576,99 @@ bmk_sched_dumpqueue(void)
 	bmk_printf("END blockq dump\n");
 }
 
+/*
+ * Run queue latency histogram: bucket 0 counts waits under 1us,
+ * bucket n > 0 waits of [2^(n-1), 2^n) us, the last bucket also
+ * counts everything longer.
+ */
+static void
+rundelay(struct bmk_thread *thread, bmk_time_t delay)
+{
+	unsigned long long us = delay / 1000;
+	unsigned int b;
+
+	if (us == 0)
+		b = 0;
+	else
+		b = 64 - __builtin_clzll(us);
+	if (b >= BMK_SCHED_RUNDELAY_BUCKETS)
+		b = BMK_SCHED_RUNDELAY_BUCKETS-1;
+	thread->bt_stats.bss_rundelay[b]++;
+}
+
+void
+bmk_sched_getstats(struct bmk_thread *thread, struct bmk_sched_stats *st)
+{
+	unsigned long flags;
+
+	flags = bmk_platform_splhigh();
+	*st = thread->bt_stats;
+	if (thread->bt_flags & THR_RUNNING)
+		st->bss_runtime += bmk_platform_cpu_clock_monotonic()
+		    - thread->bt_lastrun;
+	bmk_platform_splx(flags);
+}
+
+static void
+addstats(struct bmk_sched_stats *to, const struct bmk_sched_stats *from)
+{
+	int i;
+
+	to->bss_runtime += from->bss_runtime;
+	to->bss_nswitch += from->bss_nswitch;
+	to->bss_wakeups += from->bss_wakeups;
+	to->bss_timeouts += from->bss_timeouts;
+	for (i = 0; i < BMK_SCHED_RUNDELAY_BUCKETS; i++)
+		to->bss_rundelay[i] += from->bss_rundelay[i];
+}
+
+/*
+ * Statistics summed over all threads which have ever existed, and
+ * the time the cpu has spent idle.
+ */
+void
+bmk_sched_getprocstats(struct bmk_sched_stats *st, bmk_time_t *idle)
+{
+	struct bmk_sched_stats tst;
+	struct bmk_thread *thr;
+	unsigned long flags;
+
+	flags = bmk_platform_splhigh();
+	*st = deadstats;
+	TAILQ_FOREACH(thr, &threadq, bt_threadq) {
+		bmk_sched_getstats(thr, &tst);
+		addstats(st, &tst);
+	}
+	TAILQ_FOREACH(thr, &zombieq, bt_threadq) {
+		addstats(st, &thr->bt_stats);
+	}
+	if (idle)
+		*idle = idletime;
+	bmk_platform_splx(flags);
+}
+
+void
+bmk_sched_dumpstats(void)
+{
+	struct bmk_sched_stats st;
+	struct bmk_thread *thr;
+	int i;
+
+	bmk_printf("BEGIN sched stats (idle %lld us)\n",
+	    (long long)idletime / 1000);
+	TAILQ_FOREACH(thr, &threadq, bt_threadq) {
+		bmk_sched_getstats(thr, &st);
+		bmk_printf("thread \"%s\": run %lld us, switches %lu, "
+		    "wakeups %lu, timeouts %lu\n  rundelay:", thr->bt_name,
+		    (long long)st.bss_runtime / 1000, st.bss_nswitch,
+		    st.bss_wakeups, st.bss_timeouts);
+		for (i = 0; i < BMK_SCHED_RUNDELAY_BUCKETS; i++)
+			bmk_printf(" %lu", st.bss_rundelay[i]);
+		bmk_printf("\n");
+	}
+	bmk_printf("END sched stats\n");
+}
+
 static void
 sched_switch(struct bmk_thread *prev, struct bmk_thread *next)
 {
@@ -293,6 +676,7 @@ sched_switch(struct bmk_thread *prev, struct bmk_thread *next)
 	bmk_assert(next->bt_flags & THR_RUNNING);
 	bmk_assert((next->bt_flags & THR_QMASK) == 0);
 
+	trace(BMK_SCHED_TRACE_SWITCH, 0, prev, (unsigned long)next);
 	if (scheduler_hook)
 		scheduler_hook(prev->bt_cookie, next->bt_cookie);
 	bmk_platform_cpu_sched_settls(&next->bt_tcb);
@@ -303,6 +687,7 @@ static void
 schedule(void)
 {
 	struct bmk_thread *prev, *next, *thread;
+	bmk_time_t curtime, waketime, idlestart;
 	unsigned long flags;
 
 	prev = bmk_current;
@@ -311,10 +696,10 @@ schedule(void)
 	if (flags) {
 		bmk_platform_halt("schedule() called at !spl0");
 	}
-	for (;;) {
-		bmk_time_t curtime, waketime;
 
-		curtime = bmk_platform_cpu_clock_monotonic();
+	curtime = bmk_platform_cpu_clock_monotonic();
+	prev->bt_stats.bss_runtime += curtime - prev->bt_lastrun;
+	for (;;) {
 		waketime = curtime + BLOCKTIME_MAX;
 
 		/*
@@ -339,7 +724,7 @@ schedule(void)
 			}
 		}
 
-		if ((next = TAILQ_FIRST(&runq)) != NULL) {
+		if ((next = runq_first()) != NULL) {
 			bmk_assert(next->bt_flags & THR_RUNQ);
 			bmk_assert((next->bt_flags & THR_DEAD) == 0);
 			break;
@@ -351,11 +736,19 @@ schedule(void)
 		 * interrupts "atomically" before actually blocking.
 		 */
 		bmk_platform_cpu_block(waketime);
+		idlestart = curtime;
+		curtime = bmk_platform_cpu_clock_monotonic();
+		idletime += curtime - idlestart;
 	}
 	/* now we're committed to letting "next" run next */
 	setflags(prev, 0, THR_RUNNING);
 
-	TAILQ_REMOVE(&runq, next, bt_schedq);
+	if (prev != next)
+		next->bt_stats.bss_nswitch++;
+	rundelay(next, curtime - next->bt_enqtime);
+	next->bt_lastrun = curtime;
+
+	runq_remove(next);
 	setflags(next, THR_RUNNING, THR_RUNQ);
 	bmk_platform_splx(flags);
 
@@ -374,9 +767,13 @@ schedule(void)
 	 */
 	while ((thread = TAILQ_FIRST(&zombieq)) != NULL) {
 		TAILQ_REMOVE(&zombieq, thread, bt_threadq);
+		addstats(&deadstats, &thread->bt_stats);
 		if ((thread->bt_flags & THR_EXTSTACK) == 0)
 			stackfree(thread);
-		bmk_memfree(thread, BMK_MEMWHO_WIREDBMK);
+		if (thread->bt_flags & THR_FREETLS)
+			bmk_sched_tls_free((void *)thread->bt_tcb.btcb_tp);
+		if (!cache_put(&thrcache, thread))
+			bmk_memfree(thread, BMK_MEMWHO_WIREDBMK);
 	}
 }
 
@@ -389,7 +786,9 @@ bmk_sched_tls_alloc(void)
 {
 	char *tlsmem, *p;
 
-	tlsmem = p = bmk_memalloc(TLSAREASIZE, 0, BMK_MEMWHO_WIREDBMK);
+	if ((tlsmem = cache_get(&tlscache)) == NULL)
+		tlsmem = bmk_memalloc(TLSAREASIZE, 0, BMK_MEMWHO_WIREDBMK);
+	p = tlsmem;
 #ifdef _TLS_I
 	bmk_memset(p, 0, 2*sizeof(void *));
 	p += 2 * sizeof(void *);
@@ -408,7 +807,8 @@ bmk_sched_tls_free(void *mem)
 {
 
 	mem = (void *)((unsigned long)mem - TCBOFFSET);
-	bmk_memfree(mem, BMK_MEMWHO_WIREDBMK);
+	if (!cache_put(&tlscache, mem))
+		bmk_memfree(mem, BMK_MEMWHO_WIREDBMK);
 }
 
 void *
@@ -446,13 +846,16 @@ bmk_sched_create_withtls(const char *name, void *cookie, int joinable,
 	struct bmk_thread *thread;
 	unsigned long flags;
 
-	thread = bmk_xmalloc_bmk(sizeof(*thread));
+	if ((thread = cache_get(&thrcache)) == NULL)
+		thread = bmk_xmalloc_bmk(sizeof(*thread));
 	bmk_memset(thread, 0, sizeof(*thread));
 	bmk_strncpy(thread->bt_name, name, sizeof(thread->bt_name)-1);
+	thread->bt_pri = BMK_SCHED_PRI_DEFAULT;
 
 	if (!stack_base) {
 		bmk_assert(stack_size == 0);
 		stackalloc(&stack_base, &stack_size);
+		thread->bt_flags = THR_PAINTED;
 	} else {
 		thread->bt_flags = THR_EXTSTACK;
 	}
@@ -473,7 +876,8 @@ bmk_sched_create_withtls(const char *name, void *cookie, int joinable,
 
 	/* set runnable manually, we don't satisfy invariants yet */
 	flags = bmk_platform_splhigh();
-	TAILQ_INSERT_TAIL(&runq, thread, bt_schedq);
+	thread->bt_enqtime = bmk_platform_cpu_clock_monotonic();
+	runq_insert(thread);
 	thread->bt_flags |= THR_RUNQ;
 	bmk_platform_splx(flags);
 
@@ -541,8 +945,16 @@ bmk_sched_exit_withtls(void)
 void
 bmk_sched_exit(void)
 {
+	unsigned long flags;
+
+	/*
+	 * The tls area is still in use until we have switched away
+	 * for the last time, so leave freeing it to the reaper.
+	 */
+	flags = bmk_platform_splhigh();
+	bmk_current->bt_flags |= THR_FREETLS;
+	bmk_platform_splx(flags);
 
-	bmk_sched_tls_free((void *)bmk_current->bt_tcb.btcb_tp);
 	bmk_sched_exit_withtls();
 }
 
@@ -629,6 +1041,9 @@ bmk_sched_block(void)
 	bmk_assert((thread->bt_flags & THR_TIMEDOUT) == 0);
 	bmk_assert(thread->bt_flags & THR_BLOCKPREP);
 
+	trace(BMK_SCHED_TRACE_BLOCK,
+	    thread->bt_wakeup_time != BMK_SCHED_BLOCK_INFTIME,
+	    thread, (unsigned long)thread->bt_wakeup_time);
 	schedule();
 
 	tflags = thread->bt_flags;
@@ -640,6 +1055,18 @@ bmk_sched_block(void)
 void
 bmk_sched_wake(struct bmk_thread *thread)
 {
+	unsigned int how;
+
+	if (bmk_sched_trace_on) {
+		if (thread->bt_flags & THR_TIMEDOUT)
+			how = BMK_SCHED_TRACE_WAKE_TIMEOUT;
+		else if (trace_intrdepth)
+			how = BMK_SCHED_TRACE_WAKE_INTR;
+		else
+			how = BMK_SCHED_TRACE_WAKE_THREAD;
+		trace(BMK_SCHED_TRACE_WAKE, how,
+		    bmk_current, (unsigned long)thread);
+	}
 
 	thread->bt_wakeup_time = BMK_SCHED_BLOCK_INFTIME;
 	set_runnable(thread);
@@ -692,13 +1119,15 @@ bmk_sched_startmain(void (*mainfun)(void *), void *arg)
 	    mainfun, arg, bmk_mainstackbase, bmk_mainstacksize);
 	if (mainthread == NULL)
 		bmk_platform_halt("failed to create main thread");
+	mainthread->bt_flags |= THR_PAINTED;
 
 	/*
 	 * Manually switch to mainthread without going through
 	 * bmk_sched (avoids confusion with bmk_current).
 	 */
-	TAILQ_REMOVE(&runq, mainthread, bt_schedq);
+	runq_remove(mainthread);
 	setflags(mainthread, THR_RUNNING, THR_RUNQ);
+	mainthread->bt_lastrun = bmk_platform_cpu_clock_monotonic();
 	sched_switch(&initthread, mainthread);
 
 	bmk_platform_halt("bmk_sched_init unreachable");
@@ -719,6 +1148,35 @@ bmk_sched_init_mainlwp(void *cookie)
 	return bmk_current;
 }
 
+/*
+ * Set the priority of a thread.  A runnable thread is moved to the
+ * tail of the queue of its new priority.
+ */
+void
+bmk_sched_setpri(struct bmk_thread *thread, int pri)
+{
+	unsigned long flags;
+
+	bmk_assert(pri >= BMK_SCHED_PRI_MIN && pri <= BMK_SCHED_PRI_MAX);
+
+	flags = bmk_platform_splhigh();
+	if (thread->bt_flags & THR_RUNQ) {
+		runq_remove(thread);
+		thread->bt_pri = pri;
+		runq_insert(thread);
+	} else {
+		thread->bt_pri = pri;
+	}
+	bmk_platform_splx(flags);
+}
+
+int
+bmk_sched_getpri(struct bmk_thread *thread)
+{
+
+	return thread->bt_pri;
+}
+
 const char *
 bmk_sched_threadname(struct bmk_thread *thread)
 {
@@ -749,7 +1207,8 @@ bmk_sched_yield(void)
 	/* make schedulable and re-insert into runqueue */
 	flags = bmk_platform_splhigh();
 	setflags(thread, THR_RUNQ, THR_RUNNING);
-	TAILQ_INSERT_TAIL(&runq, thread, bt_schedq);
+	thread->bt_enqtime = bmk_platform_cpu_clock_monotonic();
+	runq_insert(thread);
 	bmk_platform_splx(flags);
 
 	schedule();
@@ -48,6 +48,7 @@
 #define _BMK_PRINTF_VA
 #include <bmk-core/null.h>
 #include <bmk-core/printf.h>
+#include <bmk-core/sched.h>
 #include <bmk-core/string.h>
 
 #define TOBUFONLY	0x01
@@ -76,6 +77,7 @@ nullfun(void)
 
 static void (*v_flush)(void);
 static void (*v_putc)(int);
+static void (*v_write)(const char *, unsigned long);
 
 void
 bmk_printf_init(void (*putc)(int), void (*flush)(void))
@@ -89,6 +91,17 @@ bmk_printf_init(void (*putc)(int), void (*flush)(void))
 	v_flush = flush;
 }
 
+/*
+ * Optional: write a batch of characters to the console.  Used for
+ * draining the output buffer instead of calling putc per character.
+ */
+void
+bmk_printf_setwrite(void (*write)(const char *, unsigned long))
+{
+
+	v_write = write;
+}
+
 static const char hexdigits[] = "0123456789abcdef";
 static const char HEXDIGITS[] = "0123456789ABCDEF";
 
@@ -103,6 +116,23 @@ static const char HEXDIGITS[] = "0123456789ABCDEF";
 char bmk_dmesg[BMK_DMESG_SIZE];
 static int bmk_dmesgoff;
 
+/*
+ * Console output buffer.  Once bmk_printf_startflusher() has been
+ * called, output is collected here and written to the console by the
+ * flusher thread when a line is complete and the current thread gives
+ * up the CPU, or synchronously if the buffer fills up.  Before that,
+ * and while a flush is in progress (i.e. when printing from an
+ * interrupt or trap which preempted the flush), characters go
+ * directly to the console.
+ */
+#ifndef BMK_CONSBUF_SIZE
+#define BMK_CONSBUF_SIZE 4096
+#endif
+static char bmk_consbuf[BMK_CONSBUF_SIZE];
+static unsigned long consbuf_prod, consbuf_cons;
+static int consbuf_flushing;
+static struct bmk_thread *consflusher;
+
 /*
  * putchar: print a single character on console or user terminal.
  *
@@ -117,7 +147,68 @@ cons_putchar(int c, int flags)
 	bmk_dmesg[bmk_dmesgoff] = c;
 	if (++bmk_dmesgoff == sizeof(bmk_dmesg)-1)
 		bmk_dmesgoff = 0;
-	(*v_putc)(c);
+
+	if (consflusher == NULL || consbuf_flushing) {
+		(*v_putc)(c);
+		return;
+	}
+
+	if (consbuf_prod - consbuf_cons == sizeof(bmk_consbuf))
+		bmk_printf_flush();
+	bmk_consbuf[consbuf_prod++ % sizeof(bmk_consbuf)] = c;
+	if (c == '\n')
+		bmk_sched_wake(consflusher);
+}
+
+/*
+ * Write out everything in the console buffer.  Also called from
+ * the platform halt routines so that no output is lost.  A range is
+ * claimed before it is written, so that a nested flush continues
+ * from where the interrupted one got to instead of repeating it.
+ */
+void
+bmk_printf_flush(void)
+{
+	unsigned long off, n, i;
+
+	consbuf_flushing++;
+	while (consbuf_cons != consbuf_prod) {
+		off = consbuf_cons % sizeof(bmk_consbuf);
+		n = consbuf_prod - consbuf_cons;
+		if (n > sizeof(bmk_consbuf) - off)
+			n = sizeof(bmk_consbuf) - off;
+		consbuf_cons += n;
+
+		if (v_write) {
+			(*v_write)(&bmk_consbuf[off], n);
+		} else {
+			for (i = 0; i < n; i++)
+				(*v_putc)(bmk_consbuf[off+i]);
+		}
+	}
+	consbuf_flushing--;
+	(*v_flush)();
+}
+
+static void
+consflush(void *arg)
+{
+
+	for (;;) {
+		bmk_printf_flush();
+		bmk_sched_blockprepare();
+		bmk_sched_block();
+	}
+}
+
+void
+bmk_printf_startflusher(void)
+{
+
+	if (consflusher)
+		return;
+	consflusher = bmk_sched_create("consflush", NULL, 0,
+	    consflush, NULL, NULL, 0);
 }
 
 static void
@@ -134,6 +225,18 @@ kprintf_unlock(void)
 	/* XXX */
 }
 
+/*
+ * Print one character, for callers which do not need formatting.
+ */
+void
+bmk_printf_putc(int c)
+{
+
+	kprintf_lock();
+	cons_putchar(c, TOCONS);
+	kprintf_unlock();
+}
+
 /*
  * bmk_printf: print a message to the console
  */
@@ -0,0 +1,199 @@
+/*-
+ * Copyright (c) 2026 The rumprun contributors.  All Rights Reserved.
+ *
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Address space management for demand paging.  Ranges of the window
+ * registered by the platform are handed out first-fit, each with a
+ * pager which is called when a thread touches an unmapped page in the
+ * range.  There is no preemption, so the region list needs no locking.
+ */
+
+#include <bmk-core/core.h>
+#include <bmk-core/errno.h>
+#include <bmk-core/memalloc.h>
+#include <bmk-core/null.h>
+#include <bmk-core/queue.h>
+#include <bmk-core/vm.h>
+
+struct vmregion {
+	unsigned long vr_start;
+	unsigned long vr_len;
+
+	bmk_vm_pager_fn vr_pager;
+	void *vr_arg;
+
+	TAILQ_ENTRY(vmregion) vr_entries;
+};
+/* sorted by address */
+static TAILQ_HEAD(, vmregion) vmregions = TAILQ_HEAD_INITIALIZER(vmregions);
+
+static const struct bmk_vmops *vmops;
+static unsigned long vmbase, vmend;
+
+static bmk_vm_pager_fn defpager;
+static void *defpager_arg;
+static bmk_vm_segv_fn segvhandler;
+
+void
+bmk_vm_init(const struct bmk_vmops *ops, unsigned long base,
+	unsigned long size)
+{
+
+	vmops = ops;
+	vmbase = base;
+	vmend = base + size;
+}
+
+void *
+bmk_vm_reserve(unsigned long len, bmk_vm_pager_fn pager, void *arg)
+{
+	struct vmregion *vr, *nvr;
+	unsigned long va;
+
+	if (vmops == NULL || len == 0)
+		return NULL;
+	len = bmk_round_page(len);
+
+	va = vmbase;
+	TAILQ_FOREACH(vr, &vmregions, vr_entries) {
+		if (vr->vr_start - va >= len)
+			break;
+		va = vr->vr_start + vr->vr_len;
+	}
+	if (vr == NULL && vmend - va < len)
+		return NULL;
+
+	nvr = bmk_memalloc(sizeof(*nvr), 0, BMK_MEMWHO_WIREDBMK);
+	if (nvr == NULL)
+		return NULL;
+	nvr->vr_start = va;
+	nvr->vr_len = len;
+	nvr->vr_pager = pager;
+	nvr->vr_arg = arg;
+	if (vr)
+		TAILQ_INSERT_BEFORE(vr, nvr, vr_entries);
+	else
+		TAILQ_INSERT_TAIL(&vmregions, nvr, vr_entries);
+
+	return (void *)va;
+}
+
+/*
+ * Release a range returned by bmk_vm_reserve().  Any pages still
+ * mapped are unmapped, freeing them is up to the caller.
+ */
+void
+bmk_vm_release(void *addr)
+{
+	struct vmregion *vr;
+	unsigned long va;
+
+	TAILQ_FOREACH(vr, &vmregions, vr_entries) {
+		if (vr->vr_start == (unsigned long)addr)
+			break;
+	}
+	bmk_assert(vr != NULL);
+
+	for (va = vr->vr_start; va < vr->vr_start + vr->vr_len;
+	    va += BMK_PCPU_PAGE_SIZE)
+		vmops->vmo_unmap(va);
+	TAILQ_REMOVE(&vmregions, vr, vr_entries);
+	bmk_memfree(vr, BMK_MEMWHO_WIREDBMK);
+}
+
+int
+bmk_vm_map(void *va, void *page, int writable)
+{
+
+	return vmops->vmo_map((unsigned long)va, page, writable);
+}
+
+void
+bmk_vm_unmap(void *va)
+{
+
+	vmops->vmo_unmap((unsigned long)va);
+}
+
+int
+bmk_vm_dirty(void *va, int clear)
+{
+
+	return vmops->vmo_dirty((unsigned long)va, clear);
+}
+
+void
+bmk_vm_setdefpager(bmk_vm_pager_fn pager, void *arg)
+{
+
+	defpager = pager;
+	defpager_arg = arg;
+}
+
+void
+bmk_vm_setsegv(bmk_vm_segv_fn handler)
+{
+
+	segvhandler = handler;
+}
+
+void
+bmk_vm_segv(unsigned long va, int write)
+{
+
+	if (segvhandler)
+		segvhandler(va, write);
+}
+
+/*
+ * Can be called from the trap handler, so only looks at the window.
+ */
+int
+bmk_vm_inwindow(unsigned long va)
+{
+
+	return vmops != NULL && va >= vmbase && va < vmend;
+}
+
+/*
+ * Resolve a fault in the window.  Called by the platform in the
+ * context of the faulting thread.  Returns 0 if the access can be
+ * retried.
+ */
+int
+bmk_vm_fault(unsigned long va, int write)
+{
+	struct vmregion *vr;
+
+	TAILQ_FOREACH(vr, &vmregions, vr_entries) {
+		if (va >= vr->vr_start && va < vr->vr_start + vr->vr_len)
+			return vr->vr_pager(vr->vr_arg,
+			    bmk_trunc_page(va), write);
+	}
+	if (defpager)
+		return defpager(defpager_arg, bmk_trunc_page(va), write);
+	return BMK_EINVAL;
+}
@@ -49,6 +49,9 @@ rumpuser_init(int version, const struct rumpuser_hyperup *hyp)
 
 	rumpuser__hyp = *hyp;
 
+	/* from now on, console output is written out in batches */
+	bmk_printf_startflusher();
+
 	return rumprun_platform_rumpuser_init();
 }
 
@@ -117,19 +120,6 @@ rumpuser_getparam(const char *name, void *buf, size_t buflen)
 	return rv;
 }
 
-/* ok, this isn't really random, but let's make-believe */
-int
-rumpuser_getrandom(void *buf, size_t buflen, int flags, size_t *retp)
-{
-	unsigned char *rndbuf;
-
-	for (*retp = 0, rndbuf = buf; *retp < buflen; (*retp)++) {
-		*rndbuf++ = bmk_platform_cpu_clock_monotonic() & 0xff;
-	}
-
-	return 0;
-}
-
 void
 rumpuser_exit(int value)
 {
@@ -0,0 +1,218 @@
+/*-
+ * Copyright (c) 2026 The rumprun contributors.  All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Random numbers for the rump kernel, and through its entropy pool
+ * and /dev/urandom, for the application.
+ *
+ * Output comes from ChaCha20 in "fast key erasure" mode: a batch of
+ * keystream blocks is generated at a time, the first 32 bytes of it
+ * replace the key and the rest is handed out and then wiped.  The key
+ * is seeded from the hardware entropy sources of the platform, and
+ * fresh hardware entropy is mixed in every RESEED_BYTES of output.
+ * Without hardware entropy we fall back to clock jitter, which is
+ * better than nothing but not by much, so complain about it.
+ */
+
+#include <bmk-core/core.h>
+#include <bmk-core/platform.h>
+#include <bmk-core/printf.h>
+#include <bmk-core/string.h>
+
+#include <bmk-rumpuser/core_types.h>
+#include <bmk-rumpuser/rumpuser.h>
+
+#define CHACHA_BLOCKSIZE	64
+#define CHACHA_KEYSIZE		32
+#define CHACHA_ROUNDS		20
+
+#define RNDBUF_BLOCKS		16
+#define RESEED_BYTES		(1024*1024)
+
+static uint32_t rndkey[CHACHA_KEYSIZE/4];
+static uint8_t rndbuf[RNDBUF_BLOCKS*CHACHA_BLOCKSIZE];
+static unsigned long rndavail;
+static unsigned long rndsincereseed;
+static int rndseeded;
+
+#define ROTL32(v, n) (((v) << (n)) | ((v) >> (32 - (n))))
+#define QROUND(a, b, c, d)						\
+do {									\
+	a += b; d ^= a; d = ROTL32(d, 16);				\
+	c += d; b ^= c; b = ROTL32(b, 12);				\
+	a += b; d ^= a; d = ROTL32(d, 8);				\
+	c += d; b ^= c; b = ROTL32(b, 7);				\
+} while (/*CONSTCOND*/0)
+
+/* "expand 32-byte k" */
+static const uint32_t sigma[4] = {
+	0x61707865, 0x3320646e, 0x79622d32, 0x6b206574
+};
+
+static void
+chacha_block(const uint32_t key[8], uint32_t counter, uint8_t *out)
+{
+	uint32_t in[16], x[16];
+	int i;
+
+	for (i = 0; i < 4; i++)
+		in[i] = sigma[i];
+	for (i = 0; i < 8; i++)
+		in[4+i] = key[i];
+	in[12] = counter;
+	in[13] = in[14] = in[15] = 0;
+
+	for (i = 0; i < 16; i++)
+		x[i] = in[i];
+	for (i = 0; i < CHACHA_ROUNDS; i += 2) {
+		QROUND(x[0], x[4], x[8],  x[12]);
+		QROUND(x[1], x[5], x[9],  x[13]);
+		QROUND(x[2], x[6], x[10], x[14]);
+		QROUND(x[3], x[7], x[11], x[15]);
+		QROUND(x[0], x[5], x[10], x[15]);
+		QROUND(x[1], x[6], x[11], x[12]);
+		QROUND(x[2], x[7], x[8],  x[13]);
+		QROUND(x[3], x[4], x[9],  x[14]);
+	}
+
+	/* little-endian output, like the reference implementation */
+	for (i = 0; i < 16; i++) {
+		x[i] += in[i];
+		out[4*i+0] = x[i];
+		out[4*i+1] = x[i] >> 8;
+		out[4*i+2] = x[i] >> 16;
+		out[4*i+3] = x[i] >> 24;
+	}
+}
+
+/*
+ * Last resort: the low bits of the clock, sampled around a loop whose
+ * duration varies with cache and pipeline state.
+ */
+static void
+clockjitter(uint8_t *buf, unsigned long len)
+{
+	bmk_time_t t;
+	unsigned long i;
+	int j;
+
+	for (i = 0; i < len; i++) {
+		for (j = 0; j < 8; j++) {
+			t = bmk_platform_cpu_clock_monotonic();
+			buf[i] = (buf[i] << 1 | buf[i] >> 7) ^ (uint8_t)t;
+		}
+	}
+}
+
+/* mix fresh entropy into the key */
+static void
+reseed(void)
+{
+	static int warned;
+	uint8_t ent[CHACHA_KEYSIZE];
+	unsigned long n;
+	int i;
+
+	bmk_memset(ent, 0, sizeof(ent));
+	n = bmk_platform_getentropy(ent, sizeof(ent));
+	if (n < sizeof(ent)) {
+		if (!warned) {
+			bmk_printf("rumpuser: no hardware entropy, "
+			    "random numbers will be weak\n");
+			warned = 1;
+		}
+		clockjitter(ent + n, sizeof(ent) - n);
+	}
+
+	for (i = 0; i < CHACHA_KEYSIZE/4; i++) {
+		rndkey[i] ^= ent[4*i] | ent[4*i+1] << 8
+		    | ent[4*i+2] << 16 | (uint32_t)ent[4*i+3] << 24;
+	}
+	bmk_memset(ent, 0, sizeof(ent));
+
+	/* anything generated with the old key is now stale */
+	bmk_memset(rndbuf, 0, sizeof(rndbuf));
+	rndavail = 0;
+	rndsincereseed = 0;
+	rndseeded = 1;
+}
+
+static void
+refill(void)
+{
+	int i;
+
+	for (i = 0; i < RNDBUF_BLOCKS; i++)
+		chacha_block(rndkey, i, rndbuf + i*CHACHA_BLOCKSIZE);
+
+	/* new key from the head of the keystream, which is then wiped */
+	for (i = 0; i < CHACHA_KEYSIZE/4; i++) {
+		rndkey[i] = rndbuf[4*i] | rndbuf[4*i+1] << 8
+		    | rndbuf[4*i+2] << 16 | (uint32_t)rndbuf[4*i+3] << 24;
+	}
+	bmk_memset(rndbuf, 0, CHACHA_KEYSIZE);
+	rndavail = sizeof(rndbuf) - CHACHA_KEYSIZE;
+}
+
+/*
+ * Mix in fresh entropy right away.  Used after the image has been
+ * resumed from a snapshot, where every copy would otherwise go on to
+ * produce the same numbers.
+ */
+void
+rumpuser_random_reseed(void)
+{
+
+	reseed();
+}
+
+/*
+ * We never block: the generator is good to go as soon as it has
+ * been seeded, which happens on the first call.  Since threads are
+ * not preempted and nothing here blocks, no locking is needed.
+ */
+int
+rumpuser_getrandom(void *buf, size_t buflen, int flags, size_t *retp)
+{
+	uint8_t *p = buf, *src;
+	size_t n, done;
+
+	if (!rndseeded || rndsincereseed >= RESEED_BYTES)
+		reseed();
+
+	for (done = 0; done < buflen; done += n) {
+		if (rndavail == 0)
+			refill();
+		n = buflen - done < rndavail ? buflen - done : rndavail;
+		src = rndbuf + sizeof(rndbuf) - rndavail;
+		bmk_memcpy(p + done, src, n);
+		bmk_memset(src, 0, n);
+		rndavail -= n;
+	}
+	rndsincereseed += buflen;
+
+	*retp = buflen;
+	return 0;
+}
@@ -33,6 +33,8 @@
 #include <bmk-core/core.h>
 #include <bmk-core/errno.h>
 #include <bmk-core/memalloc.h>
+#include <bmk-core/platform.h>
+#include <bmk-core/printf.h>
 #include <bmk-core/queue.h>
 #include <bmk-core/sched.h>
 #include <bmk-core/string.h>
@@ -43,6 +45,8 @@
 TAILQ_HEAD(waithead, waiter);
 struct waiter {
 	struct bmk_thread *who;
+	struct lwp *l;		/* for handing over rwlocks */
+	struct waithead *wh;	/* queue we are on, see requeue() */
 	TAILQ_ENTRY(waiter) entries;
 	int onlist;
 };
@@ -56,17 +60,26 @@ wait(struct waithead *wh, bmk_time_t wakeup)
 		wakeup += bmk_platform_cpu_clock_monotonic();
 
 	w.who = bmk_current;
+	w.l = rumpuser_curlwp();
+	w.wh = wh;
 	w.onlist = 1;
 	TAILQ_INSERT_TAIL(wh, &w, entries);
 
 	bmk_sched_blockprepare_timeout(wakeup);
 	bmk_sched_block();
 
-	/* woken up by timeout? */
-	if (w.onlist)
-		TAILQ_REMOVE(wh, &w, entries);
+	/*
+	 * woken up by timeout?  if we were moved to another queue,
+	 * we were already signalled and only the timeout beat the
+	 * final wakeup.
+	 */
+	if (w.onlist) {
+		TAILQ_REMOVE(w.wh, &w, entries);
+		if (w.wh == wh)
+			return BMK_ETIMEDOUT;
+	}
 
-	return w.onlist ? BMK_ETIMEDOUT : 0;
+	return 0;
 }
 
 static void
@@ -93,6 +106,125 @@ wakeup_all(struct waithead *wh)
 	}
 }
 
+/*
+ * Move waiters from one queue to the tail of another without
+ * waking them up.  Used for wait-morphing.
+ */
+static void
+requeue(struct waithead *from, struct waithead *to, int all)
+{
+	struct waiter *w;
+
+	while ((w = TAILQ_FIRST(from)) != NULL) {
+		TAILQ_REMOVE(from, w, entries);
+		w->wh = to;
+		TAILQ_INSERT_TAIL(to, w, entries);
+		if (!all)
+			break;
+	}
+}
+
+/*
+ * Optional lockstat-style accounting, enabled at build time with
+ * RUMPRUN_LOCKSTAT=yes (which defines RUMPUSER_LOCKSTAT).  Every
+ * lock carries a record which is kept on a global list so that the
+ * statistics can be dumped either from the guest via
+ * rumpuser_lockstat_dump() or from gdb via
+ * gdbscripts/bmk_lockstat.subr.  The call site stored is the return
+ * address of the most recent contended acquire, i.e. the rump kernel
+ * routine that had to wait.  For condition variables "acquires" are
+ * waits and "contended" are waits which timed out.
+ *
+ * Since we have one CPU and locks are not used from interrupt
+ * context, no protection for the list is required.
+ */
+#ifdef RUMPUSER_LOCKSTAT
+#define LS_MTX	0
+#define LS_RW	1
+#define LS_CV	2
+struct lockstat {
+	int ls_type;
+	void *ls_lock;
+	void *ls_initsite;
+	void *ls_callsite;
+
+	unsigned long ls_acquires;
+	unsigned long ls_contended;
+	bmk_time_t ls_waittime;
+
+	TAILQ_ENTRY(lockstat) ls_entries;
+};
+static TAILQ_HEAD(, lockstat) lockstats = TAILQ_HEAD_INITIALIZER(lockstats);
+
+static void
+lockstat_init(struct lockstat *ls, int type, void *lock, void *initsite)
+{
+
+	ls->ls_type = type;
+	ls->ls_lock = lock;
+	ls->ls_initsite = initsite;
+	TAILQ_INSERT_TAIL(&lockstats, ls, ls_entries);
+}
+
+static void
+lockstat_fini(struct lockstat *ls)
+{
+
+	TAILQ_REMOVE(&lockstats, ls, ls_entries);
+}
+
+#define LOCKSTAT_DECL(name)	struct lockstat name
+#define LOCKSTAT_INIT(ls, type, lock)					\
+	lockstat_init(ls, type, lock, __builtin_return_address(0))
+#define LOCKSTAT_FINI(ls)	lockstat_fini(ls)
+#define LOCKSTAT_ACQUIRE(ls)	((ls)->ls_acquires++)
+#define LOCKSTAT_TIMER(t)	bmk_time_t t = 0
+#define LOCKSTAT_START(t)	(t = bmk_platform_cpu_clock_monotonic())
+#define LOCKSTAT_CONTENDED(ls, t)					\
+  do {									\
+	(ls)->ls_contended++;						\
+	(ls)->ls_callsite = __builtin_return_address(0);		\
+	(ls)->ls_waittime += bmk_platform_cpu_clock_monotonic() - (t);	\
+  } while (0)
+#define LOCKSTAT_WAITED(ls, t)						\
+	((ls)->ls_waittime += bmk_platform_cpu_clock_monotonic() - (t))
+#else
+#define LOCKSTAT_DECL(name)
+#define LOCKSTAT_INIT(ls, type, lock)	do { } while (0)
+#define LOCKSTAT_FINI(ls)	do { } while (0)
+#define LOCKSTAT_ACQUIRE(ls)	do { } while (0)
+#define LOCKSTAT_TIMER(t)
+#define LOCKSTAT_START(t)	do { } while (0)
+#define LOCKSTAT_CONTENDED(ls, t) do { } while (0)
+#define LOCKSTAT_WAITED(ls, t)	do { } while (0)
+#endif
+
+/*
+ * Map a NetBSD kernel priority (0-223, or -1 for "don't care") to a
+ * bmk one.  Kernel threads run ahead of application threads, and the
+ * kernel real-time range (softints etc.) goes to the bmk real-time
+ * range.  The exact NetBSD priority within a range matters little
+ * with a non-preemptive scheduler.
+ */
+#define NETBSD_PRI_KERNEL_RT	192
+#define NETBSD_PRI_COUNT	224
+
+static int
+mappri(int pri)
+{
+
+	if (pri < 0)
+		return BMK_SCHED_PRI_DEFAULT;
+	if (pri < NETBSD_PRI_KERNEL_RT)
+		return BMK_SCHED_PRI_DEFAULT+1;
+	if (pri >= NETBSD_PRI_COUNT)
+		pri = NETBSD_PRI_COUNT-1;
+	return BMK_SCHED_PRI_RT + (pri - NETBSD_PRI_KERNEL_RT)
+	    * (BMK_SCHED_PRI_INTR - BMK_SCHED_PRI_RT)
+	    / (NETBSD_PRI_COUNT - NETBSD_PRI_KERNEL_RT);
+}
+
+/* we have only one cpu, so cpuidx is ignored */
 int
 rumpuser_thread_create(void *(*f)(void *), void *arg, const char *thrname,
 	int joinable, int pri, int cpuidx, void **tptr)
@@ -103,6 +235,7 @@ rumpuser_thread_create(void *(*f)(void *), void *arg, const char *thrname,
 	    (void (*)(void *))f, arg, NULL, 0);
 	if (!thr)
 		return BMK_EINVAL;
+	bmk_sched_setpri(thr, mappri(pri));
 
 	*tptr = thr;
 	return 0;
@@ -129,6 +262,7 @@ struct rumpuser_mtx {
 	int flags;
 	struct lwp *o;
 	struct bmk_thread *bmk_o;
+	LOCKSTAT_DECL(ls);
 };
 
 void
@@ -139,19 +273,34 @@ rumpuser_mutex_init(struct rumpuser_mtx **mtxp, int flags)
 	mtx = bmk_memcalloc(1, sizeof(*mtx), BMK_MEMWHO_WIREDBMK);
 	mtx->flags = flags;
 	TAILQ_INIT(&mtx->waiters);
+	LOCKSTAT_INIT(&mtx->ls, LS_MTX, mtx);
 	*mtxp = mtx;
 }
 
+/*
+ * Acquire a mutex while not holding a rump kernel CPU, so that we
+ * are free to block.
+ */
+static void
+mtx_enter_unsched(struct rumpuser_mtx *mtx)
+{
+
+	while (rumpuser_mutex_tryenter(mtx) != 0)
+		wait(&mtx->waiters, BMK_SCHED_BLOCK_INFTIME);
+}
+
 void
 rumpuser_mutex_enter(struct rumpuser_mtx *mtx)
 {
+	LOCKSTAT_TIMER(t);
 	int nlocks;
 
 	if (rumpuser_mutex_tryenter(mtx) != 0) {
+		LOCKSTAT_START(t);
 		rumpkern_unsched(&nlocks, NULL);
-		while (rumpuser_mutex_tryenter(mtx) != 0)
-			wait(&mtx->waiters, BMK_SCHED_BLOCK_INFTIME);
+		mtx_enter_unsched(mtx);
 		rumpkern_sched(nlocks, NULL);
+		LOCKSTAT_CONTENDED(&mtx->ls, t);
 	}
 }
 
@@ -181,6 +330,7 @@ rumpuser_mutex_tryenter(struct rumpuser_mtx *mtx)
 	mtx->v = 1;
 	mtx->o = l;
 	mtx->bmk_o = bmk_current;
+	LOCKSTAT_ACQUIRE(&mtx->ls);
 
 	return 0;
 }
@@ -201,6 +351,7 @@ rumpuser_mutex_destroy(struct rumpuser_mtx *mtx)
 {
 
 	bmk_assert(TAILQ_EMPTY(&mtx->waiters) && mtx->o == NULL);
+	LOCKSTAT_FINI(&mtx->ls);
 	bmk_memfree(mtx, BMK_MEMWHO_WIREDBMK);
 }
 
@@ -211,13 +362,57 @@ rumpuser_mutex_owner(struct rumpuser_mtx *mtx, struct lwp **lp)
 	*lp = mtx->o;
 }
 
+/*
+ * Reader-writer locks hand ownership directly over to waiters
+ * when released instead of waking them up to retry: a releasing
+ * writer lets in all waiting readers as one batch (or the next
+ * writer if there are no readers), and the last releasing reader
+ * lets in the next writer.  Since newly arriving readers queue
+ * behind waiting writers and newly arriving writers can never find
+ * the lock free while someone is waiting, neither side can starve
+ * the other and nobody loses a retry race.
+ *
+ * v is the number of read holds, o the owner if write-held.
+ */
 struct rumpuser_rw {
 	struct waithead rwait;
 	struct waithead wwait;
 	int v;
 	struct lwp *o;
+	LOCKSTAT_DECL(ls);
 };
 
+static void
+rw_handoff_readers(struct rumpuser_rw *rw)
+{
+	struct waiter *w;
+
+	bmk_assert(rw->o == NULL);
+	while ((w = TAILQ_FIRST(&rw->rwait)) != NULL) {
+		TAILQ_REMOVE(&rw->rwait, w, entries);
+		w->onlist = 0;
+		rw->v++;
+		LOCKSTAT_ACQUIRE(&rw->ls);
+		bmk_sched_wake(w->who);
+	}
+}
+
+static void
+rw_handoff_writer(struct rumpuser_rw *rw)
+{
+	struct waiter *w;
+
+	bmk_assert(rw->o == NULL && rw->v == 0);
+	if ((w = TAILQ_FIRST(&rw->wwait)) != NULL) {
+		TAILQ_REMOVE(&rw->wwait, w, entries);
+		w->onlist = 0;
+		bmk_assert(w->l != NULL);
+		rw->o = w->l;
+		LOCKSTAT_ACQUIRE(&rw->ls);
+		bmk_sched_wake(w->who);
+	}
+}
+
 void
 rumpuser_rw_init(struct rumpuser_rw **rwp)
 {
@@ -226,6 +421,7 @@ rumpuser_rw_init(struct rumpuser_rw **rwp)
 	rw = bmk_memcalloc(1, sizeof(*rw), BMK_MEMWHO_WIREDBMK);
 	TAILQ_INIT(&rw->rwait);
 	TAILQ_INIT(&rw->wwait);
+	LOCKSTAT_INIT(&rw->ls, LS_RW, rw);
 
 	*rwp = rw;
 }
@@ -235,6 +431,7 @@ rumpuser_rw_enter(int enum_rumprwlock, struct rumpuser_rw *rw)
 {
 	enum rumprwlock lk = enum_rumprwlock;
 	struct waithead *w = NULL;
+	LOCKSTAT_TIMER(t);
 	int nlocks;
 
 	switch (lk) {
@@ -247,10 +444,18 @@ rumpuser_rw_enter(int enum_rumprwlock, struct rumpuser_rw *rw)
 	}
 
 	if (rumpuser_rw_tryenter(enum_rumprwlock, rw) != 0) {
+		LOCKSTAT_START(t);
 		rumpkern_unsched(&nlocks, NULL);
-		while (rumpuser_rw_tryenter(enum_rumprwlock, rw) != 0)
-			wait(w, BMK_SCHED_BLOCK_INFTIME);
+		/*
+		 * Being dequeued means the lock was handed to us.
+		 * Otherwise we got a spurious wakeup and try again.
+		 */
+		while (rumpuser_rw_tryenter(enum_rumprwlock, rw) != 0) {
+			if (wait(w, BMK_SCHED_BLOCK_INFTIME) == 0)
+				break;
+		}
 		rumpkern_sched(nlocks, NULL);
+		LOCKSTAT_CONTENDED(&rw->ls, t);
 	}
 }
 
@@ -262,7 +467,7 @@ rumpuser_rw_tryenter(int enum_rumprwlock, struct rumpuser_rw *rw)
 
 	switch (lk) {
 	case RUMPUSER_RW_WRITER:
-		if (rw->o == NULL) {
+		if (rw->o == NULL && rw->v == 0) {
 			rw->o = rumpuser_curlwp();
 			rv = 0;
 		} else {
@@ -279,6 +484,8 @@ rumpuser_rw_tryenter(int enum_rumprwlock, struct rumpuser_rw *rw)
 		break;
 	}
 
+	if (rv == 0)
+		LOCKSTAT_ACQUIRE(&rw->ls);
 	return rv;
 }
 
@@ -287,17 +494,16 @@ rumpuser_rw_exit(struct rumpuser_rw *rw)
 {
 
 	if (rw->o) {
+		bmk_assert(rw->v == 0);
 		rw->o = NULL;
+		if (!TAILQ_EMPTY(&rw->rwait))
+			rw_handoff_readers(rw);
+		else
+			rw_handoff_writer(rw);
 	} else {
-		rw->v--;
-	}
-
-	/* standard procedure, don't let readers starve out writers */
-	if (!TAILQ_EMPTY(&rw->wwait)) {
-		if (rw->o == NULL)
-			wakeup_one(&rw->wwait);
-	} else if (!TAILQ_EMPTY(&rw->rwait) && rw->o == NULL) {
-		wakeup_all(&rw->rwait);
+		bmk_assert(rw->v > 0);
+		if (--rw->v == 0)
+			rw_handoff_writer(rw);
 	}
 }
 
@@ -305,6 +511,8 @@ void
 rumpuser_rw_destroy(struct rumpuser_rw *rw)
 {
 
+	bmk_assert(TAILQ_EMPTY(&rw->rwait) && TAILQ_EMPTY(&rw->wwait));
+	LOCKSTAT_FINI(&rw->ls);
 	bmk_memfree(rw, BMK_MEMWHO_WIREDBMK);
 }
 
@@ -323,20 +531,33 @@ rumpuser_rw_held(int enum_rumprwlock, struct rumpuser_rw *rw, int *rvp)
 	}
 }
 
+/*
+ * Downgrade turns our write hold into a read hold and lets in
+ * the waiting readers, unless a writer is waiting (in which case
+ * new readers would be blocked anyway).
+ */
 void
 rumpuser_rw_downgrade(struct rumpuser_rw *rw)
 {
 
-	bmk_assert(rw->o == rumpuser_curlwp());
-	rw->v = -1;
+	bmk_assert(rw->o == rumpuser_curlwp() && rw->v == 0);
+	rw->o = NULL;
+	rw->v = 1;
+	if (TAILQ_EMPTY(&rw->wwait))
+		rw_handoff_readers(rw);
 }
 
+/*
+ * Upgrade succeeds only if we are the sole reader.  The caller
+ * must hold a read lock.
+ */
 int
 rumpuser_rw_tryupgrade(struct rumpuser_rw *rw)
 {
 
-	if (rw->v == -1) {
-		rw->v = 1;
+	bmk_assert(rw->o == NULL && rw->v > 0);
+	if (rw->v == 1) {
+		rw->v = 0;
 		rw->o = rumpuser_curlwp();
 		return 0;
 	}
@@ -347,6 +568,8 @@ rumpuser_rw_tryupgrade(struct rumpuser_rw *rw)
 struct rumpuser_cv {
 	struct waithead waiters;
 	int nwaiters;
+	struct rumpuser_mtx *mtx;	/* interlock of current waiters */
+	LOCKSTAT_DECL(ls);
 };
 
 void
@@ -356,6 +579,7 @@ rumpuser_cv_init(struct rumpuser_cv **cvp)
 
 	cv = bmk_memcalloc(1, sizeof(*cv), BMK_MEMWHO_WIREDBMK);
 	TAILQ_INIT(&cv->waiters);
+	LOCKSTAT_INIT(&cv->ls, LS_CV, cv);
 	*cvp = cv;
 }
 
@@ -364,9 +588,27 @@ rumpuser_cv_destroy(struct rumpuser_cv *cv)
 {
 
 	bmk_assert(cv->nwaiters == 0);
+	LOCKSTAT_FINI(&cv->ls);
 	bmk_memfree(cv, BMK_MEMWHO_WIREDBMK);
 }
 
+static void
+cv_enter(struct rumpuser_cv *cv, struct rumpuser_mtx *mtx)
+{
+
+	bmk_assert(cv->mtx == NULL || cv->mtx == mtx);
+	cv->mtx = mtx;
+	cv->nwaiters++;
+}
+
+static void
+cv_leave(struct rumpuser_cv *cv)
+{
+
+	if (--cv->nwaiters == 0)
+		cv->mtx = NULL;
+}
+
 static void
 cv_unsched(struct rumpuser_mtx *mtx, int *nlocks)
 {
@@ -385,7 +627,7 @@ cv_resched(struct rumpuser_mtx *mtx, int nlocks)
 		rumpkern_sched(nlocks, mtx);
 		rumpuser_mutex_enter_nowrap(mtx);
 	} else {
-		rumpuser_mutex_enter_nowrap(mtx);
+		mtx_enter_unsched(mtx);
 		rumpkern_sched(nlocks, mtx);
 	}
 }
@@ -393,54 +635,98 @@ cv_resched(struct rumpuser_mtx *mtx, int nlocks)
 void
 rumpuser_cv_wait(struct rumpuser_cv *cv, struct rumpuser_mtx *mtx)
 {
+	LOCKSTAT_TIMER(t);
 	int nlocks;
 
-	cv->nwaiters++;
+	LOCKSTAT_ACQUIRE(&cv->ls);
+	LOCKSTAT_START(t);
+	cv_enter(cv, mtx);
 	cv_unsched(mtx, &nlocks);
 	wait(&cv->waiters, BMK_SCHED_BLOCK_INFTIME);
 	cv_resched(mtx, nlocks);
-	cv->nwaiters--;
+	cv_leave(cv);
+	LOCKSTAT_WAITED(&cv->ls, t);
 }
 
 void
 rumpuser_cv_wait_nowrap(struct rumpuser_cv *cv, struct rumpuser_mtx *mtx)
 {
+	LOCKSTAT_TIMER(t);
 
-	cv->nwaiters++;
+	LOCKSTAT_ACQUIRE(&cv->ls);
+	LOCKSTAT_START(t);
+	cv_enter(cv, mtx);
 	rumpuser_mutex_exit(mtx);
 	wait(&cv->waiters, BMK_SCHED_BLOCK_INFTIME);
 	rumpuser_mutex_enter_nowrap(mtx);
-	cv->nwaiters--;
+	cv_leave(cv);
+	LOCKSTAT_WAITED(&cv->ls, t);
 }
 
 int
 rumpuser_cv_timedwait(struct rumpuser_cv *cv, struct rumpuser_mtx *mtx,
 	int64_t sec, int64_t nsec)
 {
+	LOCKSTAT_TIMER(t);
 	int nlocks;
 	int rv;
 
-	cv->nwaiters++;
+	LOCKSTAT_ACQUIRE(&cv->ls);
+	LOCKSTAT_START(t);
+	cv_enter(cv, mtx);
 	cv_unsched(mtx, &nlocks);
 	rv = wait(&cv->waiters, sec * 1000*1000*1000ULL + nsec);
 	cv_resched(mtx, nlocks);
-	cv->nwaiters--;
+	cv_leave(cv);
+	if (rv != 0)
+		LOCKSTAT_CONTENDED(&cv->ls, t);
+	else
+		LOCKSTAT_WAITED(&cv->ls, t);
 
 	return rv;
 }
 
+/*
+ * Wait-morphing: if the interlock is held (typically by the caller),
+ * waking up the waiters would only make them contend for it.  Instead,
+ * move them directly onto the mutex's wait queue so that each
+ * rumpuser_mutex_exit() makes exactly one of them runnable.
+ * Spin mutexes are reacquired only after the rump kernel CPU
+ * (see cv_resched()), so their waiters are woken up normally.
+ */
+static int
+cv_canmorph(struct rumpuser_cv *cv)
+{
+	struct rumpuser_mtx *mtx = cv->mtx;
+
+	if (TAILQ_EMPTY(&cv->waiters))
+		return 0;
+
+	bmk_assert(mtx != NULL);
+	if ((mtx->flags & (RUMPUSER_MTX_KMUTEX | RUMPUSER_MTX_SPIN)) ==
+	    (RUMPUSER_MTX_KMUTEX | RUMPUSER_MTX_SPIN))
+		return 0;
+	return mtx->v;
+}
+
 void
 rumpuser_cv_signal(struct rumpuser_cv *cv)
 {
 
-	wakeup_one(&cv->waiters);
+	if (cv_canmorph(cv))
+		requeue(&cv->waiters, &cv->mtx->waiters, 0);
+	else
+		wakeup_one(&cv->waiters);
 }
 
 void
 rumpuser_cv_broadcast(struct rumpuser_cv *cv)
 {
 
-	wakeup_all(&cv->waiters);
+	if (cv_canmorph(cv))
+		requeue(&cv->waiters, &cv->mtx->waiters, 1);
+	else
+		wakeup_all(&cv->waiters);
 }
 
 void
@@ -450,6 +736,58 @@ rumpuser_cv_has_waiters(struct rumpuser_cv *cv, int *rvp)
 	*rvp = cv->nwaiters != 0;
 }
 
+/*
+ * lockstat
+ */
+
+#ifdef RUMPUSER_LOCKSTAT
+void
+rumpuser_lockstat_dump(void)
+{
+	static const char *lstypes[] = { "mtx", "rw", "cv" };
+	struct lockstat *ls;
+
+	bmk_printf("BEGIN lockstat dump\n");
+	bmk_printf("type lock               initsite           callsite"
+	    "           acquires  contended waittime(ns)\n");
+	TAILQ_FOREACH(ls, &lockstats, ls_entries) {
+		if (ls->ls_contended == 0)
+			continue;
+		bmk_printf("%-4s %-18p %-18p %-18p %9lu %10lu %lld\n",
+		    lstypes[ls->ls_type], ls->ls_lock,
+		    ls->ls_initsite, ls->ls_callsite,
+		    ls->ls_acquires, ls->ls_contended,
+		    (long long)ls->ls_waittime);
+	}
+	bmk_printf("END lockstat dump\n");
+}
+
+void
+rumpuser_lockstat_reset(void)
+{
+	struct lockstat *ls;
+
+	TAILQ_FOREACH(ls, &lockstats, ls_entries) {
+		ls->ls_callsite = NULL;
+		ls->ls_acquires = ls->ls_contended = 0;
+		ls->ls_waittime = 0;
+	}
+}
+#else
+void
+rumpuser_lockstat_dump(void)
+{
+
+	bmk_printf("lockstat not available, build with RUMPRUN_LOCKSTAT=yes\n");
+}
+
+void
+rumpuser_lockstat_reset(void)
+{
+
+}
+#endif
+
 /*
  * curlwp
  */
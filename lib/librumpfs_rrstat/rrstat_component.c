@@ -0,0 +1,98 @@
+/*-
+ * Copyright (c) 2026 The rumprun contributors.  All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * /kern/rumprun/stat: a /proc-like view of the unikernel's cpu and
+ * memory usage, see rumpcomp_rrstat_format() for the contents.
+ * Unlike getrusage(), this is available also to programs which do
+ * not run on top of the rumprun libc, e.g. over sysproxy.
+ */
+
+#include <sys/param.h>
+#include <sys/dirent.h>
+#include <sys/kmem.h>
+#include <sys/uio.h>
+#include <sys/vnode.h>
+
+#include <miscfs/kernfs/kernfs.h>
+
+#include "rump_private.h"
+
+#include "rrstat_user.h"
+
+#define RRSTAT_BUFSIZE 1024
+
+static int
+rrstat_read(void *v)
+{
+	struct vop_read_args /* {
+		struct vnode *a_vp;
+		struct uio *a_uio;
+		int a_ioflag;
+		kauth_cred_t a_cred;
+	} */ *ap = v;
+	struct uio *uio = ap->a_uio;
+	char *buf;
+	int len, error = 0;
+
+	if (uio->uio_offset < 0)
+		return EINVAL;
+
+	buf = kmem_alloc(RRSTAT_BUFSIZE, KM_SLEEP);
+	len = rumpcomp_rrstat_format(buf, RRSTAT_BUFSIZE);
+	if (len >= RRSTAT_BUFSIZE)
+		len = RRSTAT_BUFSIZE-1;
+	if (uio->uio_offset < len)
+		error = uiomove(buf + uio->uio_offset,
+		    len - uio->uio_offset, uio);
+	kmem_free(buf, RRSTAT_BUFSIZE);
+
+	return error;
+}
+
+static const struct kernfs_fileop rrstat_fileops[] = {
+	{ .kf_fileop = KERNFS_FILEOP_READ, .kf_vop = rrstat_read },
+};
+
+#define DIR_MODE	(S_IRUSR|S_IXUSR|S_IRGRP|S_IXGRP|S_IROTH|S_IXOTH)
+#define FILE_MODE	(S_IRUSR|S_IRGRP|S_IROTH)
+
+RUMP_COMPONENT(RUMP_COMPONENT_VFS)
+{
+	kernfs_parentdir_t *pkt;
+	kernfs_entry_t *dkt;
+	kfstype kfst;
+
+	KERNFS_ALLOCENTRY(dkt, M_TEMP, M_WAITOK);
+	KERNFS_INITENTRY(dkt, DT_DIR, "rumprun", NULL, KFSsubdir, VDIR,
+	    DIR_MODE);
+	kernfs_addentry(NULL, dkt);
+	pkt = KERNFS_ENTOPARENTDIR(dkt);
+
+	kfst = KERNFS_ALLOCTYPE(rrstat_fileops);
+	KERNFS_ALLOCENTRY(dkt, M_TEMP, M_WAITOK);
+	KERNFS_INITENTRY(dkt, DT_REG, "stat", NULL, kfst, VREG, FILE_MODE);
+	kernfs_addentry(pkt, dkt);
+}
@@ -0,0 +1,78 @@
+/*-
+ * Copyright (c) 2026 The rumprun contributors.  All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <bmk-core/core.h>
+#include <bmk-core/memalloc.h>
+#include <bmk-core/pgalloc.h>
+#include <bmk-core/printf.h>
+#include <bmk-core/sched.h>
+
+#include "rrstat_user.h"
+
+int
+rumpcomp_rrstat_format(char *buf, unsigned long len)
+{
+	struct bmk_sched_stats st;
+	bmk_time_t idle;
+	unsigned long totalkb, usedkb, maxusedkb;
+	unsigned long off;
+	const char *name;
+	bmk_time_t t;
+	int i;
+
+	bmk_sched_getprocstats(&st, &idle);
+	bmk_pgalloc_usage(&totalkb, &usedkb, &maxusedkb);
+
+	off = bmk_snprintf(buf, len,
+	    "cpu_busy_ns %lld\n"
+	    "cpu_idle_ns %lld\n"
+	    "switches %lu\n"
+	    "wakeups %lu\n"
+	    "timeouts %lu\n"
+	    "mem_total_kb %lu\n"
+	    "mem_used_kb %lu\n"
+	    "mem_maxused_kb %lu\n"
+	    "malloc_bmk_kb %lu\n"
+	    "malloc_rumpkern_kb %lu\n"
+	    "malloc_user_kb %lu\n"
+	    "rundelay_us",
+	    (long long)st.bss_runtime, (long long)idle,
+	    st.bss_nswitch, st.bss_wakeups, st.bss_timeouts,
+	    totalkb, usedkb, maxusedkb,
+	    bmk_memalloc_inuse(BMK_MEMWHO_WIREDBMK) >> 10,
+	    bmk_memalloc_inuse(BMK_MEMWHO_RUMPKERN) >> 10,
+	    bmk_memalloc_inuse(BMK_MEMWHO_USER) >> 10);
+	for (i = 0; i < BMK_SCHED_RUNDELAY_BUCKETS && off < len; i++)
+		off += bmk_snprintf(buf + off, len - off, " %lu",
+		    st.bss_rundelay[i]);
+	if (off < len)
+		off += bmk_snprintf(buf + off, len - off, "\n");
+
+	for (i = 0; bmk_core_getbootphase(i, &name, &t) && off < len; i++)
+		off += bmk_snprintf(buf + off, len - off, "boot_%s_us %lld\n",
+		    name, (long long)t / 1000);
+
+	return off;
+}
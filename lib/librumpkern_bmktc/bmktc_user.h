@@ -24,3 +24,5 @@
  */
 
 unsigned int rumpcomp_bmktc_gettime(void);
+unsigned int rumpcomp_bmktc_getcounter(void);
+unsigned long long rumpcomp_bmktc_counterfreq(void);
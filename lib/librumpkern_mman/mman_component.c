@@ -53,8 +53,11 @@ static const struct rump_onesyscall mysys[] = {
 };
 #undef ENTRY
 
+void rumprun_mman_init(void);
+
 RUMP_COMPONENT(RUMP_COMPONENT_SYSCALL)
 {
 
+	rumprun_mman_init();
 	rump_syscall_boot_establish(mysys, __arraycount(mysys));
 }
@@ -0,0 +1,95 @@
+/*-
+ * Copyright (c) 2026 The rumprun contributors.  All Rights Reserved.
+ *
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <bmk-core/null.h>
+#include <bmk-core/pgalloc.h>
+#include <bmk-core/vm.h>
+
+#include "mman_user.h"
+
+void *
+rumpcomp_mman_reserve(unsigned long len, rumpcomp_mman_pager_fn pager,
+	void *arg)
+{
+
+	return bmk_vm_reserve(len, pager, arg);
+}
+
+void
+rumpcomp_mman_release(void *va)
+{
+
+	bmk_vm_release(va);
+}
+
+int
+rumpcomp_mman_map(void *va, void *page, int writable)
+{
+
+	return bmk_vm_map(va, page, writable);
+}
+
+void
+rumpcomp_mman_unmap(void *va)
+{
+
+	bmk_vm_unmap(va);
+}
+
+int
+rumpcomp_mman_dirty(void *va, int clear)
+{
+
+	return bmk_vm_dirty(va, clear);
+}
+
+void
+rumpcomp_mman_setdefpager(rumpcomp_mman_pager_fn pager)
+{
+
+	bmk_vm_setdefpager(pager, NULL);
+}
+
+void
+rumpcomp_mman_segv(unsigned long va, int write)
+{
+
+	bmk_vm_segv(va, write);
+}
+
+void *
+rumpcomp_mman_pgalloc(unsigned long npgs)
+{
+
+	return bmk_pgalloc_pages(npgs);
+}
+
+void
+rumpcomp_mman_pgfree(void *va, unsigned long npgs)
+{
+
+	bmk_pgfree_pages(va, npgs);
+}
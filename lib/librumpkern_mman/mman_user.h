@@ -0,0 +1,48 @@
+/*-
+ * Copyright (c) 2026 The rumprun contributors.  All Rights Reserved.
+ *
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Interface to the demand paging support of the platform, see
+ * bmk-core/vm.h.  rumpcomp_mman_reserve() returns NULL if the
+ * platform does not support demand paging.
+ */
+
+typedef int (*rumpcomp_mman_pager_fn)(void *, unsigned long, int);
+
+void	*rumpcomp_mman_reserve(unsigned long, rumpcomp_mman_pager_fn, void *);
+void	rumpcomp_mman_release(void *);
+int	rumpcomp_mman_map(void *, void *, int);
+void	rumpcomp_mman_unmap(void *);
+int	rumpcomp_mman_dirty(void *, int);
+void	rumpcomp_mman_setdefpager(rumpcomp_mman_pager_fn);
+void	rumpcomp_mman_segv(unsigned long, int);
+
+/*
+ * Page runs for anonymous memory.  Any page-aligned subrange of an
+ * allocation may be freed separately.
+ */
+void	*rumpcomp_mman_pgalloc(unsigned long);
+void	rumpcomp_mman_pgfree(void *, unsigned long);
@@ -27,40 +27,93 @@
  * Memory management syscall implementations.  These are mostly ~nops,
  * apart from mmap, which we sort of attempt to emulate since many
  * programs reserve memory using mmap instead of malloc.
+ *
+ * If the platform supports demand paging, file mappings are paged in
+ * on access and MAP_SHARED writable mappings are written back on
+ * msync() and munmap().  Otherwise, file mappings are read-only and
+ * read in their entirety at mmap() time.  Either way the mapped pages
+ * are copies, not the page cache pages, so a page of a file which is
+ * both cached and mapped takes up memory twice.
  */
 
 #include <sys/cdefs.h>
 
 #include <sys/param.h>
+#include <sys/atomic.h>
+#include <sys/condvar.h>
 #include <sys/errno.h>
 #include <sys/file.h>
 #include <sys/filedesc.h>
+#include <sys/kauth.h>
 #include <sys/kmem.h>
+#include <sys/kthread.h>
+#include <sys/lwp.h>
 #include <sys/mman.h>
+#include <sys/mutex.h>
+#include <sys/once.h>
 #include <sys/queue.h>
+#include <sys/rbtree.h>
 #include <sys/syscall.h>
 #include <sys/syscallargs.h>
+#include <sys/vnode.h>
 
 #include "rump_private.h"
 
+#include "mman_user.h"
+
 #ifdef RUMPRUN_MMAP_DEBUG
 #define MMAP_PRINTF(x) printf x
 #else
 #define MMAP_PRINTF(x)
 #endif
 
+/*
+ * Anonymous memory.  The chunks are indexed by start address so that
+ * munmap() finds the chunk(s) covering an address in logarithmic
+ * time.  Pages are returned to the page allocator as soon as they
+ * are unmapped, splitting a chunk if its middle is unmapped.
+ */
 struct mmapchunk {
 	void *mm_start;
 	size_t mm_size;
-	size_t mm_pgsleft;
 
-	LIST_ENTRY(mmapchunk) mm_chunks;
+	rb_node_t mm_node;
+};
+static rb_tree_t mmc_tree;
+static kmutex_t mmc_lock;
+
+static int
+cmpva(const void *va1, const void *va2)
+{
+
+	if (va1 < va2)
+		return -1;
+	if (va1 > va2)
+		return 1;
+	return 0;
+}
+
+static int
+mmc_compare_nodes(void *ctx, const void *n1, const void *n2)
+{
+	const struct mmapchunk *mc1 = n1, *mc2 = n2;
+
+	return cmpva(mc1->mm_start, mc2->mm_start);
+}
+
+static int
+mmc_compare_key(void *ctx, const void *n, const void *key)
+{
+	const struct mmapchunk *mc = n;
+
+	return cmpva(mc->mm_start, key);
+}
+
+static const rb_tree_ops_t mmc_tree_ops = {
+	.rbto_compare_nodes = mmc_compare_nodes,
+	.rbto_compare_key = mmc_compare_key,
+	.rbto_node_offset = offsetof(struct mmapchunk, mm_node),
 };
-/*
- * XXX: use a tree?  we don't know how many entries we get,
- * someone might mmap pages individually ...
- */
-static LIST_HEAD(, mmapchunk) mmc_list = LIST_HEAD_INITIALIZER(&mmc_list);
 
 static void *
 mmapmem_alloc(size_t roundedlen)
@@ -68,48 +121,519 @@ mmapmem_alloc(size_t roundedlen)
 	struct mmapchunk *mc;
 	void *v;
 
-	mc = kmem_alloc(sizeof(*mc), KM_SLEEP);
-	if (mc == NULL)
+	if ((v = rumpcomp_mman_pgalloc(roundedlen / PAGE_SIZE)) == NULL)
 		return NULL;
 
-	v = rump_hypermalloc(roundedlen, PAGE_SIZE, true, "mmapmem");
-
+	mc = kmem_alloc(sizeof(*mc), KM_SLEEP);
 	mc->mm_start = v;
 	mc->mm_size = roundedlen;
-	mc->mm_pgsleft = roundedlen / PAGE_SIZE;
 
-	LIST_INSERT_HEAD(&mmc_list, mc, mm_chunks);
+	mutex_enter(&mmc_lock);
+	rb_tree_insert_node(&mmc_tree, mc);
+	mutex_exit(&mmc_lock);
 
 	return v;
 }
 
+/*
+ * Free [addr, addr+roundedlen).  The range may span several chunks
+ * and holes between them, but must hit at least one chunk.
+ */
 static int
 mmapmem_free(void *addr, size_t roundedlen)
 {
-	struct mmapchunk *mc;
-	size_t npgs;
+	struct mmapchunk *mc, *next, *newmc;
+	uint8_t *start = addr, *end = start + roundedlen;
+	uint8_t *mcstart, *mcend, *lo, *hi;
+	int error = EINVAL;
+
+	mutex_enter(&mmc_lock);
+	mc = rb_tree_find_node_leq(&mmc_tree, addr);
+	if (mc == NULL || (uint8_t *)mc->mm_start + mc->mm_size <= start)
+		mc = rb_tree_find_node_geq(&mmc_tree, addr);
+
+	for (; mc != NULL && (uint8_t *)mc->mm_start < end; mc = next) {
+		next = rb_tree_iterate(&mmc_tree, mc, RB_DIR_RIGHT);
+
+		mcstart = mc->mm_start;
+		mcend = mcstart + mc->mm_size;
+		lo = MAX(start, mcstart);
+		hi = MIN(end, mcend);
+		rumpcomp_mman_pgfree(lo, (hi - lo) / PAGE_SIZE);
+		error = 0;
+
+		/* trimming does not change the order of the chunks */
+		if (lo == mcstart && hi == mcend) {
+			rb_tree_remove_node(&mmc_tree, mc);
+			kmem_free(mc, sizeof(*mc));
+		} else if (lo == mcstart) {
+			mc->mm_start = hi;
+			mc->mm_size = mcend - hi;
+		} else if (hi == mcend) {
+			mc->mm_size = lo - mcstart;
+		} else {
+			newmc = kmem_alloc(sizeof(*newmc), KM_SLEEP);
+			newmc->mm_start = hi;
+			newmc->mm_size = mcend - hi;
+			mc->mm_size = lo - mcstart;
+			rb_tree_insert_node(&mmc_tree, newmc);
+		}
+	}
+	mutex_exit(&mmc_lock);
+
+	return error;
+}
+
+/*
+ * Demand-paged file mappings.  A page is filled from the file the
+ * first time it is touched, FILEMAP_CLUSTER pages at a time to cut
+ * down on the number of faults for sequential access.  The pages are
+ * private copies, so changes to the file by write(2) are not seen in
+ * existing mappings, and changes to a MAP_SHARED mapping reach the
+ * file when msync() or munmap() writes back the pages which the MMU
+ * has marked dirty.
+ *
+ * The faulting thread may be in the rump kernel holding any locks, so
+ * the file is read by a pager thread while the faulting thread waits.
+ * The exception is a fault with the vnode locked exclusively by the
+ * faulting lwp itself, e.g. write(2) to a file from its own mapping,
+ * which is resolved in place under that lock.  The vnode lock is
+ * always taken before fm_lock.
+ *
+ * The tree holds a reference to a mapping until all of its pages have
+ * been munmapped, and lookups and faults hold one while they use it.
+ */
+#define FILEMAP_CLUSTER 8
+#define FILEMAP_GONE ((void *)1)	/* page munmapped */
+
+#define FILEMAP_WRITEBACK(fm) \
+    (((fm)->fm_flags & MAP_SHARED) && ((fm)->fm_prot & PROT_WRITE))
+
+struct filemap {
+	void *fm_va;
+	size_t fm_npages;
+	size_t fm_pgsleft;
+	unsigned int fm_refcnt;
+
+	struct vnode *fm_vp;
+	kauth_cred_t fm_cred;
+	off_t fm_off;
+	int fm_prot;
+	int fm_flags;
+
+	kmutex_t fm_lock;
+	void **fm_pages;
+
+	rb_node_t fm_node;
+};
+static rb_tree_t fm_tree;
+static kmutex_t fm_treelock;
+
+struct fmreq {
+	struct filemap *fr_fm;
+	size_t fr_idx;
+	int fr_write;
+
+	int fr_error;
+	bool fr_done;
+
+	TAILQ_ENTRY(fmreq) fr_entries;
+};
+static TAILQ_HEAD(, fmreq) fmq = TAILQ_HEAD_INITIALIZER(fmq);
+static kmutex_t fmq_lock;
+static kcondvar_t fmq_cv;
+static kcondvar_t fmq_donecv;
+static ONCE_DECL(fm_pageronce);
+
+static int
+fm_compare_nodes(void *ctx, const void *n1, const void *n2)
+{
+	const struct filemap *fm1 = n1, *fm2 = n2;
 
-	LIST_FOREACH(mc, &mmc_list, mm_chunks) {
-		if (mc->mm_start <= addr &&
-		    ((uint8_t *)mc->mm_start + mc->mm_size
-		      >= (uint8_t *)addr + roundedlen))
+	return cmpva(fm1->fm_va, fm2->fm_va);
+}
+
+static int
+fm_compare_key(void *ctx, const void *n, const void *key)
+{
+	const struct filemap *fm = n;
+
+	return cmpva(fm->fm_va, key);
+}
+
+static const rb_tree_ops_t fm_tree_ops = {
+	.rbto_compare_nodes = fm_compare_nodes,
+	.rbto_compare_key = fm_compare_key,
+	.rbto_node_offset = offsetof(struct filemap, fm_node),
+};
+
+static int filemap_nomap(void *, unsigned long, int);
+
+void rumprun_mman_init(void);
+void
+rumprun_mman_init(void)
+{
+
+	rb_tree_init(&mmc_tree, &mmc_tree_ops);
+	mutex_init(&mmc_lock, MUTEX_DEFAULT, IPL_NONE);
+	rb_tree_init(&fm_tree, &fm_tree_ops);
+	mutex_init(&fm_treelock, MUTEX_DEFAULT, IPL_NONE);
+	mutex_init(&fmq_lock, MUTEX_DEFAULT, IPL_NONE);
+	cv_init(&fmq_cv, "mmapreq");
+	cv_init(&fmq_donecv, "mmapflt");
+
+	rumpcomp_mman_setdefpager(filemap_nomap);
+}
+
+static void *
+filemap_va(struct filemap *fm, size_t idx)
+{
+
+	return (uint8_t *)fm->fm_va + idx*PAGE_SIZE;
+}
+
+/* returns the mapping covering the range with a reference held */
+static struct filemap *
+filemap_lookup(void *addr, size_t len)
+{
+	struct filemap *fm;
+
+	mutex_enter(&fm_treelock);
+	fm = rb_tree_find_node_leq(&fm_tree, addr);
+	if (fm != NULL && (uint8_t *)addr + len
+	    > (uint8_t *)filemap_va(fm, fm->fm_npages))
+		fm = NULL;
+	if (fm != NULL)
+		atomic_inc_uint(&fm->fm_refcnt);
+	mutex_exit(&fm_treelock);
+
+	return fm;
+}
+
+static void
+filemap_release(struct filemap *fm)
+{
+
+	/*
+	 * There is no preemption, so no fault can find the range
+	 * between the last reference going away and the range being
+	 * released below.
+	 */
+	if (atomic_dec_uint_nv(&fm->fm_refcnt) > 0)
+		return;
+
+	rumpcomp_mman_release(fm->fm_va);
+	vrele(fm->fm_vp);
+	kauth_cred_free(fm->fm_cred);
+	mutex_destroy(&fm->fm_lock);
+	kmem_free(fm->fm_pages, fm->fm_npages * sizeof(*fm->fm_pages));
+	kmem_free(fm, sizeof(*fm));
+}
+
+/* lock order is the vnode, then fm_lock, see above */
+static void
+filemap_lock(struct filemap *fm)
+{
+
+	if (FILEMAP_WRITEBACK(fm))
+		vn_lock(fm->fm_vp, LK_EXCLUSIVE | LK_RETRY);
+	mutex_enter(&fm->fm_lock);
+}
+
+static void
+filemap_unlock(struct filemap *fm)
+{
+
+	mutex_exit(&fm->fm_lock);
+	if (FILEMAP_WRITEBACK(fm))
+		VOP_UNLOCK(fm->fm_vp);
+}
+
+/*
+ * Fill the cluster of pages starting at idx.  Called with the vnode
+ * locked, at least shared.  Returns EFAULT if the access is not
+ * allowed.
+ */
+static int
+filemap_pagein(struct filemap *fm, size_t idx, int write)
+{
+	size_t i, resid;
+	void *pg;
+	int error = 0;
+
+	mutex_enter(&fm->fm_lock);
+	if (fm->fm_pages[idx] == FILEMAP_GONE
+	    || (write && (fm->fm_prot & PROT_WRITE) == 0)) {
+		error = EFAULT;
+		goto out;
+	}
+
+	/* another thread may have paged it in while we waited */
+	for (i = idx; i < fm->fm_npages && i < idx + FILEMAP_CLUSTER; i++) {
+		if (fm->fm_pages[i] != NULL)
+			break;
+
+		pg = rump_hypermalloc(PAGE_SIZE, PAGE_SIZE, true, "mmapfile");
+		error = vn_rdwr(UIO_READ, fm->fm_vp, pg, PAGE_SIZE,
+		    fm->fm_off + i*PAGE_SIZE, UIO_SYSSPACE, IO_NODELOCKED,
+		    fm->fm_cred, &resid, curlwp);
+		if (error) {
+			rump_hyperfree(pg, PAGE_SIZE);
 			break;
+		}
+		/* past the end of the file is zero-filled */
+		if (resid)
+			memset((uint8_t *)pg + PAGE_SIZE - resid, 0, resid);
+
+		error = rumpcomp_mman_map(filemap_va(fm, i), pg,
+		    (fm->fm_prot & PROT_WRITE) != 0);
+		if (error) {
+			rump_hyperfree(pg, PAGE_SIZE);
+			break;
+		}
+		fm->fm_pages[i] = pg;
 	}
-	if (!mc) {
-		return EINVAL;
+	/* only the faulting page must succeed */
+	if (fm->fm_pages[idx] != NULL)
+		error = 0;
+
+ out:
+	mutex_exit(&fm->fm_lock);
+	return error;
+}
+
+static void
+filemap_pager(void *arg)
+{
+	struct fmreq *fr;
+	struct filemap *fm;
+
+	mutex_enter(&fmq_lock);
+	for (;;) {
+		while ((fr = TAILQ_FIRST(&fmq)) == NULL)
+			cv_wait(&fmq_cv, &fmq_lock);
+		TAILQ_REMOVE(&fmq, fr, fr_entries);
+		mutex_exit(&fmq_lock);
+
+		fm = fr->fr_fm;
+		vn_lock(fm->fm_vp, LK_SHARED | LK_RETRY);
+		fr->fr_error = filemap_pagein(fm, fr->fr_idx, fr->fr_write);
+		VOP_UNLOCK(fm->fm_vp);
+
+		mutex_enter(&fmq_lock);
+		fr->fr_done = true;
+		cv_broadcast(&fmq_donecv);
+	}
+}
+
+static int
+filemap_startpager(void)
+{
+
+	return kthread_create(PRI_NONE, KTHREAD_MPSAFE, NULL,
+	    filemap_pager, NULL, NULL, "mmappager");
+}
+
+/*
+ * An access which cannot be satisfied.  Outside of the rump kernel the
+ * program is terminated and this does not return.  Within it, there is
+ * no way to fail the access, so the fault fails and the platform halts.
+ */
+static int
+filemap_badaccess(unsigned long va, int write, bool inkernel)
+{
+
+	if (inkernel) {
+		printf("mmap: %s fault at 0x%lx in the kernel\n",
+		    write ? "write" : "read", va);
+	} else {
+		rumpcomp_mman_segv(va, write);
 	}
+	return EFAULT;
+}
+
+/*
+ * Called in the context of the thread which faulted on va.  The
+ * thread may or may not have been running in the rump kernel.
+ */
+static int
+filemap_fault(void *arg, unsigned long va, int write)
+{
+	struct filemap *fm = arg;
+	struct lwp *l = curlwp;
+	struct fmreq fr;
+	bool inkernel;
+	int error;
+
+	/* before anything which may block, see filemap_release() */
+	atomic_inc_uint(&fm->fm_refcnt);
+
+	inkernel = l != NULL && l->l_stat == LSONPROC;
+	if (!inkernel)
+		rump_schedule();
+
+	memset(&fr, 0, sizeof(fr));
+	fr.fr_fm = fm;
+	fr.fr_idx = (va - (unsigned long)fm->fm_va) / PAGE_SIZE;
+	fr.fr_write = write;
+
+	if (inkernel && VOP_ISLOCKED(fm->fm_vp) == LK_EXCLUSIVE) {
+		/* we hold the vnode lock, the pager would wait for us */
+		error = filemap_pagein(fm, fr.fr_idx, write);
+	} else {
+		mutex_enter(&fmq_lock);
+		TAILQ_INSERT_TAIL(&fmq, &fr, fr_entries);
+		cv_signal(&fmq_cv);
+		while (!fr.fr_done)
+			cv_wait(&fmq_donecv, &fmq_lock);
+		mutex_exit(&fmq_lock);
+		error = fr.fr_error;
+	}
+	filemap_release(fm);
+
+	if (!inkernel)
+		rump_unschedule();
+	if (error == EFAULT)
+		return filemap_badaccess(va, write, inkernel);
+	return error;
+}
+
+/*
+ * Fault in the demand paging window outside of any mapping, i.e. a
+ * touch of a range which has been munmapped entirely.
+ */
+static int
+filemap_nomap(void *arg, unsigned long va, int write)
+{
+	struct lwp *l = curlwp;
+
+	return filemap_badaccess(va, write,
+	    l != NULL && l->l_stat == LSONPROC);
+}
+
+/*
+ * Write back the dirty pages in [start, end) of a MAP_SHARED writable
+ * mapping.  Pages past the end of the file are not written, so the
+ * file is never extended.  Called with the mapping locked.
+ */
+static int
+filemap_flush(struct filemap *fm, size_t start, size_t end, int ioflag)
+{
+	struct vattr vattr;
+	off_t off;
+	size_t i, len;
+	int error;
 
-	npgs = roundedlen / PAGE_SIZE;
-	KASSERT(npgs <= mc->mm_pgsleft);
-	mc->mm_pgsleft -= npgs;
-	if (mc->mm_pgsleft)
+	if (!FILEMAP_WRITEBACK(fm))
 		return 0;
 
-	/* no pages left => free bookkeeping chunk */
-	LIST_REMOVE(mc, mm_chunks);
-	kmem_free(mc->mm_start, mc->mm_size);
-	kmem_free(mc, sizeof(*mc));
+	if ((error = VOP_GETATTR(fm->fm_vp, &vattr, fm->fm_cred)) != 0)
+		return error;
 
+	for (i = start; i < end; i++) {
+		if (fm->fm_pages[i] == NULL || fm->fm_pages[i] == FILEMAP_GONE)
+			continue;
+		if (!rumpcomp_mman_dirty(filemap_va(fm, i), 1))
+			continue;
+
+		off = fm->fm_off + i*PAGE_SIZE;
+		if (off >= vattr.va_size)
+			continue;
+		len = MIN(PAGE_SIZE, vattr.va_size - off);
+		error = vn_rdwr(UIO_WRITE, fm->fm_vp, fm->fm_pages[i], len,
+		    off, UIO_SYSSPACE, ioflag | IO_NODELOCKED, fm->fm_cred,
+		    NULL, curlwp);
+		if (error) {
+			/* redirty through the mapping for the next attempt */
+			*(volatile uint8_t *)filemap_va(fm, i) =
+			    *(volatile uint8_t *)filemap_va(fm, i);
+			break;
+		}
+	}
+
+	return error;
+}
+
+/* unmap and free pages [start, end), the caller has flushed them */
+static void
+filemap_drop(struct filemap *fm, size_t start, size_t end, void *newstate)
+{
+	size_t i;
+
+	for (i = start; i < end; i++) {
+		if (fm->fm_pages[i] == FILEMAP_GONE)
+			continue;
+		if (fm->fm_pages[i] != NULL) {
+			rumpcomp_mman_unmap(filemap_va(fm, i));
+			rump_hyperfree(fm->fm_pages[i], PAGE_SIZE);
+		}
+		fm->fm_pages[i] = newstate;
+		if (newstate == FILEMAP_GONE)
+			fm->fm_pgsleft--;
+	}
+}
+
+static int
+filemap_create(struct file *fp, size_t roundedlen, off_t off, int prot,
+	int flags, void **vp)
+{
+	struct filemap *fm;
+
+	if (RUN_ONCE(&fm_pageronce, filemap_startpager) != 0)
+		return EOPNOTSUPP;
+
+	fm = kmem_zalloc(sizeof(*fm), KM_SLEEP);
+	fm->fm_npages = fm->fm_pgsleft = roundedlen / PAGE_SIZE;
+	fm->fm_refcnt = 1;
+	fm->fm_pages = kmem_zalloc(fm->fm_npages * sizeof(*fm->fm_pages),
+	    KM_SLEEP);
+	fm->fm_va = rumpcomp_mman_reserve(roundedlen, filemap_fault, fm);
+	if (fm->fm_va == NULL) {
+		kmem_free(fm->fm_pages, fm->fm_npages * sizeof(*fm->fm_pages));
+		kmem_free(fm, sizeof(*fm));
+		return EOPNOTSUPP;
+	}
+
+	fm->fm_vp = fp->f_data;
+	vref(fm->fm_vp);
+	fm->fm_cred = fp->f_cred;
+	kauth_cred_hold(fm->fm_cred);
+	fm->fm_off = off;
+	fm->fm_prot = prot;
+	fm->fm_flags = flags;
+	mutex_init(&fm->fm_lock, MUTEX_DEFAULT, IPL_NONE);
+
+	mutex_enter(&fm_treelock);
+	rb_tree_insert_node(&fm_tree, fm);
+	mutex_exit(&fm_treelock);
+
+	*vp = fm->fm_va;
+	return 0;
+}
+
+static int
+filemap_unmap(struct filemap *fm, void *addr, size_t roundedlen)
+{
+	size_t start, end, pgsleft;
+	bool last;
+
+	start = ((uint8_t *)addr - (uint8_t *)fm->fm_va) / PAGE_SIZE;
+	end = start + roundedlen / PAGE_SIZE;
+
+	filemap_lock(fm);
+	filemap_flush(fm, start, end, 0);
+	pgsleft = fm->fm_pgsleft;
+	filemap_drop(fm, start, end, FILEMAP_GONE);
+	last = pgsleft != 0 && fm->fm_pgsleft == 0;
+	filemap_unlock(fm);
+
+	/* drop the reference of the tree */
+	if (last) {
+		mutex_enter(&fm_treelock);
+		rb_tree_remove_node(&fm_tree, fm);
+		mutex_exit(&fm_treelock);
+		filemap_release(fm);
+	}
 	return 0;
 }
 
@@ -130,16 +654,15 @@ sys_mmap(struct lwp *l, const struct sys_mmap_args *uap, register_t *retval)
 	MMAP_PRINTF(("-> mmap: %p %zu, 0x%x, 0x%x, %d, %" PRId64 "\n",
 	    SCARG(uap, addr), len, prot, flags, fd, pos));
 
-	if (fd != -1 && prot != PROT_READ) {
-		MMAP_PRINTF(("mmap: trying to r/w map a file. failing!\n"));
-		return EOPNOTSUPP;
-	}
-
 	/* we're not going to even try */
 	if (flags & MAP_FIXED) {
 		return ENOMEM;
 	}
 
+	if (len == 0) {
+		return EINVAL;
+	}
+
 	/* offset should be aligned to page size */
 	if ((pos & (PAGE_SIZE-1)) != 0) {
 		return EINVAL;
@@ -147,13 +670,12 @@ sys_mmap(struct lwp *l, const struct sys_mmap_args *uap, register_t *retval)
 
 	/* allocate full whatever-we-lie-to-be-pages */
 	roundedlen = roundup2(len, PAGE_SIZE);
-	if ((v = mmapmem_alloc(roundedlen)) == NULL) {
-		return ENOMEM;
-	}
-
-	*retval = (register_t)v;
 
 	if (flags & MAP_ANON) {
+		if ((v = mmapmem_alloc(roundedlen)) == NULL) {
+			return ENOMEM;
+		}
+		*retval = (register_t)v;
 		memset(v, 0, roundedlen);
 		return 0;
 	}
@@ -173,6 +695,32 @@ sys_mmap(struct lwp *l, const struct sys_mmap_args *uap, register_t *retval)
 		fd_putfile(fd);
 		return ENODEV;
 	}
+	if ((flags & MAP_SHARED) && (prot & PROT_WRITE)
+	    && (fp->f_flag & FWRITE) == 0) {
+		fd_putfile(fd);
+		return EACCES;
+	}
+
+	error = filemap_create(fp, roundedlen, pos, prot, flags, &v);
+	if (error != EOPNOTSUPP) {
+		fd_putfile(fd);
+		if (error == 0)
+			*retval = (register_t)v;
+		MMAP_PRINTF(("<- mmap: %p %d (paged)\n", v, error));
+		return error;
+	}
+
+	/* no demand paging, read the whole thing now */
+	if (prot != PROT_READ) {
+		MMAP_PRINTF(("mmap: trying to r/w map a file. failing!\n"));
+		fd_putfile(fd);
+		return EOPNOTSUPP;
+	}
+	if ((v = mmapmem_alloc(roundedlen)) == NULL) {
+		fd_putfile(fd);
+		return ENOMEM;
+	}
+	*retval = (register_t)v;
 
 	error = dofileread(fd, fp, v, roundedlen, &pos, 0, &cnt);
 	if (error) {
@@ -200,7 +748,11 @@ sys___msync13(struct lwp *l, const struct sys___msync13_args *uap,
 	register_t *retval)
 {
 	void *addr = SCARG(uap, addr);
+	size_t len = SCARG(uap, len);
 	int flags = SCARG(uap, flags);
+	struct filemap *fm;
+	size_t start, end;
+	int error;
 
 	/* catch a few easy errors */
 	if (((uintptr_t)addr & (PAGE_SIZE-1)) != 0)
@@ -208,8 +760,24 @@ sys___msync13(struct lwp *l, const struct sys___msync13_args *uap,
 	if ((flags & (MS_SYNC|MS_ASYNC)) == (MS_SYNC|MS_ASYNC))
 		return EINVAL;
 
-	/* otherwise just pretend that we are the champions my friend */
-	return 0;
+	/* anonymous memory: just pretend that we are the champions */
+	len = roundup2(len, PAGE_SIZE);
+	if ((fm = filemap_lookup(addr, len)) == NULL)
+		return 0;
+
+	start = ((uint8_t *)addr - (uint8_t *)fm->fm_va) / PAGE_SIZE;
+	end = start + len / PAGE_SIZE;
+
+	filemap_lock(fm);
+	error = filemap_flush(fm, start, end, (flags & MS_SYNC) ? IO_SYNC : 0);
+	if (error == 0 && (flags & MS_INVALIDATE)) {
+		/* next access rereads from the file */
+		filemap_drop(fm, start, end, NULL);
+	}
+	filemap_unlock(fm);
+	filemap_release(fm);
+
+	return error;
 }
 
 int
@@ -217,6 +785,7 @@ sys_munmap(struct lwp *l, const struct sys_munmap_args *uap, register_t *retval)
 {
 	void *addr = SCARG(uap, addr);
 	size_t len = SCARG(uap, len);
+	struct filemap *fm;
 	int rv;
 
 	MMAP_PRINTF(("-> munmap: %p, %zu\n", addr, len));
@@ -227,7 +796,12 @@ sys_munmap(struct lwp *l, const struct sys_munmap_args *uap, register_t *retval)
 		goto out;
 	}
 
-	rv =  mmapmem_free(addr, roundup2(len, PAGE_SIZE));
+	len = roundup2(len, PAGE_SIZE);
+	if ((fm = filemap_lookup(addr, len)) != NULL) {
+		rv = filemap_unmap(fm, addr, len);
+		filemap_release(fm);
+	} else
+		rv = mmapmem_free(addr, len);
 
  out:
 	MMAP_PRINTF(("<- munmap: %d\n", rv));
@@ -48,6 +48,7 @@
 #include <bmk-core/sched.h>
 
 #include <rumprun-base/makelwp.h>
+#include <rumprun-base/rumprun.h>
 
 #include "rumprun-private.h"
 
@@ -61,6 +62,9 @@ struct rumprun_lwp {
 	struct lwpctl rl_lwpctl;
 	int rl_no_parking_hare;	/* a looney tunes reference ... finally! */
 
+	int rl_policy;
+	int rl_prio;
+
 	TAILQ_ENTRY(rumprun_lwp) rl_entries;
 };
 static TAILQ_HEAD(, rumprun_lwp) all_lwp = TAILQ_HEAD_INITIALIZER(all_lwp);
@@ -69,6 +73,10 @@ static __thread struct rumprun_lwp *me;
 #define FIRST_LWPID 1
 static int curlwpid = FIRST_LWPID;
 
+/* accounting summed over exited lwps, see rumprun_lwp_gettotals() */
+static long long exitedruntime;
+static unsigned long exitednswitch;
+
 static struct rumprun_lwp mainthread = {
 	.rl_lwpid = FIRST_LWPID,
 };
@@ -235,7 +243,10 @@ _lwp_park(clockid_t clock_id, int flags, const struct timespec *ts,
 		bmk_time_t nsecs = ts->tv_sec*1000*1000*1000 + ts->tv_nsec;
 
 		if (flags & TIMER_ABSTIME) {
-			nsecs -= bmk_platform_cpu_clock_epochoffset();
+			if (clock_id == CLOCK_REALTIME)
+				nsecs -= rumprun_clock_rtoffset();
+			else if (clock_id == CLOCK_MONOTONIC)
+				nsecs -= rumprun_clock_monooffset();
 		} else {
 			nsecs += bmk_platform_cpu_clock_monotonic();
 		}
@@ -256,11 +267,16 @@ _lwp_park(clockid_t clock_id, int flags, const struct timespec *ts,
 int
 _lwp_exit(void)
 {
+	struct bmk_sched_stats st;
 
 	me->rl_lwpctl.lc_curcpu = LWPCTL_CPU_EXITED;
 	rump_pub_lwproc_releaselwp();
 	TAILQ_REMOVE(&all_lwp, me, rl_entries);
 
+	bmk_sched_getstats(me->rl_thread, &st);
+	exitedruntime += st.bss_runtime;
+	exitednswitch += st.bss_nswitch;
+
 	/* could just assign it here, but for symmetry! */
 	assignme(bmk_sched_gettcb(), NULL);
 
@@ -319,6 +335,48 @@ _lwp_setname(lwpid_t lid, const char *name)
 	return 0;
 }
 
+int
+rumprun_lwp_getstats(int lid, struct rumprun_lwpstats *rls)
+{
+	struct bmk_sched_stats st;
+	struct rumprun_lwp *rl;
+	int i;
+
+	if ((rl = lwpid2rl(lid)) == NULL)
+		return ESRCH;
+
+	bmk_sched_getstats(rl->rl_thread, &st);
+	rls->rls_runtime = st.bss_runtime;
+	rls->rls_nswitch = st.bss_nswitch;
+	rls->rls_wakeups = st.bss_wakeups;
+	rls->rls_timeouts = st.bss_timeouts;
+	__CTASSERT(RUMPRUN_RUNDELAY_BUCKETS == BMK_SCHED_RUNDELAY_BUCKETS);
+	for (i = 0; i < RUMPRUN_RUNDELAY_BUCKETS; i++)
+		rls->rls_rundelay[i] = st.bss_rundelay[i];
+
+	return 0;
+}
+
+/*
+ * Run time and number of switches summed over all application lwps,
+ * including the ones which have exited.  The rump kernel's threads
+ * are not included.
+ */
+void
+rumprun_lwp_gettotals(long long *runtime, unsigned long *nswitch)
+{
+	struct bmk_sched_stats st;
+	struct rumprun_lwp *rl;
+
+	*runtime = exitedruntime;
+	*nswitch = exitednswitch;
+	TAILQ_FOREACH(rl, &all_lwp, rl_entries) {
+		bmk_sched_getstats(rl->rl_thread, &st);
+		*runtime += st.bss_runtime;
+		*nswitch += st.bss_nswitch;
+	}
+}
+
 lwpid_t
 _lwp_self(void)
 {
@@ -326,6 +384,79 @@ _lwp_self(void)
 	return me->rl_lwpid;
 }
 
+/*
+ * Scheduling parameters, used by pthread_setschedparam() and friends.
+ * SCHED_FIFO and SCHED_RR threads are placed in the bmk real-time
+ * priority range below the interrupt threads.  Both behave like
+ * SCHED_FIFO, since the bmk scheduler does not preempt.  There is
+ * only one process, so pid is ignored.
+ */
+#define RT_PRIMIN 0	/* NetBSD's range for SCHED_FIFO/SCHED_RR */
+#define RT_PRIMAX 63
+
+int _sched_setparam(pid_t, lwpid_t, int, const struct sched_param *);
+int
+_sched_setparam(pid_t pid, lwpid_t lid, int policy,
+	const struct sched_param *params)
+{
+	struct rumprun_lwp *rl;
+	int pri;
+
+	rl = lid == 0 ? me : lwpid2rl(lid);
+	if (rl == NULL) {
+		errno = ESRCH;
+		return -1;
+	}
+
+	if (policy == SCHED_NONE)
+		policy = rl->rl_policy;
+	switch (policy) {
+	case SCHED_OTHER:
+		pri = BMK_SCHED_PRI_DEFAULT;
+		break;
+	case SCHED_FIFO:
+	case SCHED_RR:
+		if (params->sched_priority < RT_PRIMIN
+		    || params->sched_priority > RT_PRIMAX) {
+			errno = EINVAL;
+			return -1;
+		}
+		pri = BMK_SCHED_PRI_RT + (params->sched_priority - RT_PRIMIN)
+		    * (BMK_SCHED_PRI_INTR-1 - BMK_SCHED_PRI_RT)
+		    / (RT_PRIMAX - RT_PRIMIN);
+		break;
+	default:
+		errno = EINVAL;
+		return -1;
+	}
+
+	rl->rl_policy = policy;
+	rl->rl_prio = params->sched_priority;
+	bmk_sched_setpri(rl->rl_thread, pri);
+
+	return 0;
+}
+
+int _sched_getparam(pid_t, lwpid_t, int *, struct sched_param *);
+int
+_sched_getparam(pid_t pid, lwpid_t lid, int *policy,
+	struct sched_param *params)
+{
+	struct rumprun_lwp *rl;
+
+	rl = lid == 0 ? me : lwpid2rl(lid);
+	if (rl == NULL) {
+		errno = ESRCH;
+		return -1;
+	}
+
+	if (policy)
+		*policy = rl->rl_policy;
+	params->sched_priority = rl->rl_prio;
+
+	return 0;
+}
+
 /* XXX: messy.  see sched.h, libc, libpthread, and all over */
 int _sys_sched_yield(void);
 int
@@ -386,9 +517,7 @@ int rasctl(void) { return ENOSYS; }
  * so I will just stub them out for now.
  */
 __strong_alias(_sched_getaffinity,_lwpnullop);
-__strong_alias(_sched_getparam,_lwpnullop);
 __strong_alias(_sched_setaffinity,_lwpnullop);
-__strong_alias(_sched_setparam,_lwpnullop);
 
 /*
  * Technically, specifying a lower >0 protection level is an error,
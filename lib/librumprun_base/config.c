@@ -32,7 +32,12 @@
 #include <sys/param.h>
 #include <sys/disklabel.h>
 #include <sys/ioctl.h>
+#include <sys/socket.h>
 #include <sys/stat.h>
+#include <sys/sysctl.h>
+
+#include <net/if.h>
+#include <netinet/in.h>
 
 #include <ufs/ufs/ufsmount.h>
 #include <isofs/cd9660/cd9660_mount.h>
@@ -43,6 +48,7 @@
 #include <err.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -332,15 +338,150 @@ config_ipv6(const char *ifname, const char *method,
 	}
 }
 
+/*
+ * Interface configuration, DHCP in particular, can take a while, and
+ * nothing else in the config depends on it.  So each interface is
+ * configured in a thread of its own and rumprun_config_netwait()
+ * is the barrier which makes sure that networking is up before the
+ * application starts.
+ */
+struct netconfig {
+	const char *nc_ifname, *nc_cloner, *nc_type, *nc_method;
+	const char *nc_addr, *nc_mask, *nc_gw;
+	const char *nc_mtu, *nc_txqlen, *nc_tso, *nc_csum;
+
+	pthread_t nc_thread;
+	SLIST_ENTRY(netconfig) nc_entries;
+};
+static SLIST_HEAD(, netconfig) netconfigs = SLIST_HEAD_INITIALIZER(netconfigs);
+
+#define IFCAP_TSO (IFCAP_TSOv4 | IFCAP_TSOv6)
+#define IFCAP_CSUM (IFCAP_CSUM_IPv4_Rx | IFCAP_CSUM_IPv4_Tx		\
+    | IFCAP_CSUM_TCPv4_Rx | IFCAP_CSUM_TCPv4_Tx				\
+    | IFCAP_CSUM_UDPv4_Rx | IFCAP_CSUM_UDPv4_Tx				\
+    | IFCAP_CSUM_TCPv6_Rx | IFCAP_CSUM_TCPv6_Tx				\
+    | IFCAP_CSUM_UDPv6_Rx | IFCAP_CSUM_UDPv6_Tx)
+
+/* turn on the capabilities in mask which the interface has, or off */
+static uint64_t
+setcaps(uint64_t enabled, uint64_t supported, uint64_t mask,
+	const char *what, const char *value)
+{
+
+	if (strcmp(value, "on") == 0) {
+		return enabled | (supported & mask);
+	} else if (strcmp(value, "off") == 0) {
+		return enabled & ~mask;
+	} else {
+		errx(1, "\"%s\" must be \"on\" or \"off\", got \"%s\"",
+		    what, value);
+	}
+}
+
+/*
+ * Interface knobs which must be set before the interface is given
+ * an address: MTU, offloads and the length of the transmit queue.
+ */
+static void
+config_ifparams(struct netconfig *nc)
+{
+	struct ifcapreq ifcr;
+	struct ifreq ifr;
+	char name[64];
+	int s, val;
+
+	s = socket(strcmp(nc->nc_type, "inet6") == 0 ? AF_INET6 : AF_INET,
+	    SOCK_DGRAM, 0);
+	if (s == -1)
+		err(1, "rumprun_config: socket");
+
+	if (nc->nc_mtu) {
+		memset(&ifr, 0, sizeof(ifr));
+		strlcpy(ifr.ifr_name, nc->nc_ifname, sizeof(ifr.ifr_name));
+		ifr.ifr_mtu = atoi(nc->nc_mtu);
+		if (ioctl(s, SIOCSIFMTU, &ifr) == -1)
+			err(1, "%s: setting mtu %s failed",
+			    nc->nc_ifname, nc->nc_mtu);
+	}
+
+	if (nc->nc_tso || nc->nc_csum) {
+		memset(&ifcr, 0, sizeof(ifcr));
+		strlcpy(ifcr.ifcr_name, nc->nc_ifname, sizeof(ifcr.ifcr_name));
+		if (ioctl(s, SIOCGIFCAP, &ifcr) == -1)
+			err(1, "%s: getting capabilities failed",
+			    nc->nc_ifname);
+		if (nc->nc_tso)
+			ifcr.ifcr_capenable = setcaps(ifcr.ifcr_capenable,
+			    ifcr.ifcr_capabilities, IFCAP_TSO,
+			    "tso", nc->nc_tso);
+		if (nc->nc_csum)
+			ifcr.ifcr_capenable = setcaps(ifcr.ifcr_capenable,
+			    ifcr.ifcr_capabilities, IFCAP_CSUM,
+			    "csum", nc->nc_csum);
+		if (ioctl(s, SIOCSIFCAP, &ifcr) == -1)
+			err(1, "%s: setting capabilities failed",
+			    nc->nc_ifname);
+	}
+
+	close(s);
+
+	if (nc->nc_txqlen) {
+		snprintf(name, sizeof(name),
+		    "net.interfaces.%s.sndq.maxlen", nc->nc_ifname);
+		val = atoi(nc->nc_txqlen);
+		if (sysctlbyname(name, NULL, NULL, &val, sizeof(val)) == -1)
+			err(1, "%s: setting txqlen %s failed",
+			    nc->nc_ifname, nc->nc_txqlen);
+	}
+}
+
+static void *
+config_net(void *arg)
+{
+	struct netconfig *nc = arg;
+	int rv;
+
+	if (nc->nc_cloner) {
+		if ((rv = rump_pub_netconfig_ifcreate(nc->nc_ifname)) != 0) {
+			errx(1, "rumprun_config: ifcreate %s failed: %d",
+			    nc->nc_ifname, rv);
+		}
+	}
+
+	if (nc->nc_mtu || nc->nc_txqlen || nc->nc_tso || nc->nc_csum)
+		config_ifparams(nc);
+
+	if (strcmp(nc->nc_type, "inet") == 0) {
+		config_ipv4(nc->nc_ifname, nc->nc_method,
+		    nc->nc_addr, nc->nc_mask, nc->nc_gw);
+	} else if (strcmp(nc->nc_type, "inet6") == 0) {
+		config_ipv6(nc->nc_ifname, nc->nc_method,
+		    nc->nc_addr, nc->nc_mask, nc->nc_gw);
+	} else {
+		errx(1, "network type \"%s\" not supported", nc->nc_type);
+	}
+
+	return NULL;
+}
+
+void
+rumprun_config_netwait(void)
+{
+	struct netconfig *nc;
+
+	while ((nc = SLIST_FIRST(&netconfigs)) != NULL) {
+		SLIST_REMOVE_HEAD(&netconfigs, nc_entries);
+		pthread_join(nc->nc_thread, NULL);
+		free(nc);
+	}
+}
+
 static int
 handle_net(jsmntok_t *t, int left, char *data)
 {
-	const char *ifname, *cloner, *type, *method;
-	const char *addr, *mask, *gw;
+	struct netconfig *nc;
 	jsmntok_t *key, *value;
 	int i, objsize;
-	int rv;
-	static int configured;
 
 	T_CHECKTYPE(t, data, JSMN_OBJECT, __func__);
 
@@ -351,13 +492,10 @@ handle_net(jsmntok_t *t, int left, char *data)
 	}
 	t++;
 
-	if (configured) {
-		errx(1, "currently only 1 \"net\" configuration is supported");
+	if ((nc = calloc(1, sizeof(*nc))) == NULL) {
+		errx(1, "rumprun_config: failed to allocate net cfg");
 	}
 
-	ifname = cloner = type = method = NULL;
-	addr = mask = gw = NULL;
-
 	for (i = 0; i < objsize; i++, t+=2) {
 		const char *valuestr;
 		key = t;
@@ -376,43 +514,101 @@ handle_net(jsmntok_t *t, int left, char *data)
 		 */
 		valuestr = token2cstr(value, data);
 		if (T_STREQ(key, data, "if")) {
-			ifname = valuestr;
+			nc->nc_ifname = valuestr;
 		} else if (T_STREQ(key, data, "cloner")) {
-			cloner = valuestr;
+			nc->nc_cloner = valuestr;
 		} else if (T_STREQ(key, data, "type")) {
-			type = valuestr;
+			nc->nc_type = valuestr;
 		} else if (T_STREQ(key, data, "method")) {
-			method = valuestr;
+			nc->nc_method = valuestr;
 		} else if (T_STREQ(key, data, "addr")) {
-			addr = valuestr;
+			nc->nc_addr = valuestr;
 		} else if (T_STREQ(key, data, "mask")) {
 			/* XXX: we could also pass mask as a number ... */
-			mask = valuestr;
+			nc->nc_mask = valuestr;
 		} else if (T_STREQ(key, data, "gw")) {
-			gw = valuestr;
+			nc->nc_gw = valuestr;
+		} else if (T_STREQ(key, data, "mtu")) {
+			nc->nc_mtu = valuestr;
+		} else if (T_STREQ(key, data, "txqlen")) {
+			nc->nc_txqlen = valuestr;
+		} else if (T_STREQ(key, data, "tso")) {
+			nc->nc_tso = valuestr;
+		} else if (T_STREQ(key, data, "csum")) {
+			nc->nc_csum = valuestr;
 		} else {
 			errx(1, "unexpected key \"%.*s\" in \"%s\"",
 			    T_PRINTFSTAR(key, data), __func__);
 		}
 	}
 
-	if (!ifname || !type || !method) {
+	if (!nc->nc_ifname || !nc->nc_type || !nc->nc_method) {
 		errx(1, "net cfg missing vital data, not configuring");
 	}
 
-	if (cloner) {
-		if ((rv = rump_pub_netconfig_ifcreate(ifname)) != 0) {
-			errx(1, "rumprun_config: ifcreate %s failed: %d",
-			    ifname, rv);
-		}
+	if (pthread_create(&nc->nc_thread, NULL, config_net, nc) != 0) {
+		errx(1, "rumprun_config: failed to start configuring %s",
+		    nc->nc_ifname);
 	}
+	SLIST_INSERT_HEAD(&netconfigs, nc, nc_entries);
 
-	if (strcmp(type, "inet") == 0) {
-		config_ipv4(ifname, method, addr, mask, gw);
-	} else if (strcmp(type, "inet6") == 0) {
-		config_ipv6(ifname, method, addr, mask, gw);
+	return 2*objsize + 1;
+}
+
+/*
+ * Set sysctl nodes, e.g. socket buffer sizes.  Numeric values are
+ * set as integers of the size the node has, others as strings.
+ */
+static void
+config_sysctl(const char *name, const char *value)
+{
+	int32_t v32;
+	int64_t v64;
+	size_t len = 0;
+	char *ep;
+	int rv;
+
+	if (sysctlbyname(name, NULL, &len, NULL, 0) == -1)
+		err(1, "sysctl %s", name);
+
+	v64 = strtoll(value, &ep, 0);
+	if (*value != '\0' && *ep == '\0' && len == sizeof(v32)) {
+		v32 = v64;
+		rv = sysctlbyname(name, NULL, NULL, &v32, sizeof(v32));
+	} else if (*value != '\0' && *ep == '\0' && len == sizeof(v64)) {
+		rv = sysctlbyname(name, NULL, NULL, &v64, sizeof(v64));
 	} else {
-		errx(1, "network type \"%s\" not supported", type);
+		rv = sysctlbyname(name, NULL, NULL, value, strlen(value)+1);
+	}
+	if (rv == -1)
+		err(1, "sysctl %s=%s", name, value);
+}
+
+static int
+handle_sysctl(jsmntok_t *t, int left, char *data)
+{
+	jsmntok_t *key, *value;
+	int i, objsize;
+
+	T_CHECKTYPE(t, data, JSMN_OBJECT, __func__);
+
+	objsize = t->size;
+	if (left < 2*objsize + 1) {
+		return -1;
+	}
+	t++;
+
+	for (i = 0; i < objsize; i++, t+=2) {
+		key = t;
+		value = t+1;
+
+		T_CHECKTYPE(key, data, JSMN_STRING, __func__);
+		T_CHECKSIZE(key, data, 1, __func__);
+
+		T_CHECKTYPE(value, data, JSMN_STRING, __func__);
+		T_CHECKSIZE(value, data, 0, __func__);
+
+		config_sysctl(token2cstr(key, data), token2cstr(value, data));
 	}
 
 	return 2*objsize + 1;
@@ -660,6 +856,7 @@ struct {
 	{ "hostname", handle_hostname },
 	{ "blk", handle_blk },
 	{ "net", handle_net },
+	{ "sysctl", handle_sysctl },
 };
 
 /* don't believe we can have a >64k config */
@@ -30,5 +30,11 @@ void _netbsd_userlevel_init(void);
 void _netbsd_userlevel_fini(void);
 
 void rumprun_lwp_init(void);
+void rumprun_lwp_gettotals(long long *, unsigned long *);
+
+void rumprun_segv(unsigned long, int);
+
+long long rumprun_clock_monooffset(void);
+long long rumprun_clock_rtoffset(void);
 
 #endif /* _RUMPRUN_BASE_RUMPRUN_PRIVATE_H_ */
@@ -33,11 +33,13 @@
 #include <assert.h>
 #include <err.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <pthread.h>
 #include <stdio.h>
 #include <sched.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <rump/rump.h>
@@ -45,7 +47,9 @@
 
 #include <fs/tmpfs/tmpfs_args.h>
 
+#include <bmk-core/core.h>
 #include <bmk-core/platform.h>
+#include <bmk-core/vm.h>
 
 #include <rumprun-base/rumprun.h>
 #include <rumprun-base/config.h>
@@ -76,6 +80,68 @@ __weak_alias(rump_init_server,rumprun_enosys);
 
 int rumprun_cold = 1;
 
+/*
+ * Print the time at which each boot phase completed.  The same
+ * numbers are available from /kern/rumprun/stat if kernfs is there.
+ */
+static void
+bootphases_print(void)
+{
+	const char *name;
+	bmk_time_t t;
+	int i;
+
+	fprintf(stderr, "boot phases (ms):");
+	for (i = 0; bmk_core_getbootphase(i, &name, &t); i++) {
+		t /= 100*1000;
+		fprintf(stderr, " %s %lld.%lld", name,
+		    (long long)t / 10, (long long)t % 10);
+	}
+	fprintf(stderr, "\n");
+}
+
+/* XXX: manual proto.  lives in libbmk_rumpuser */
+void rumpuser_random_reseed(void);
+
+/*
+ * Boot once, save the image at this point, and start later copies
+ * from here instead of from scratch.  When we get control back, we
+ * may be one of many copies started at an arbitrary later time.
+ */
+static void
+snapshot(void)
+{
+	struct {
+		bmk_time_t now;
+		char ent[32];
+	} seed;
+	struct timespec ts;
+	bmk_time_t now, wall;
+	int fd, error;
+
+	if ((error = bmk_platform_snapshot()) != 0) {
+		warnx("snapshot not supported: %s", strerror(error));
+		return;
+	}
+
+	now = bmk_platform_cpu_clock_monotonic();
+	wall = now + bmk_platform_cpu_clock_epochoffset();
+	ts.tv_sec = wall / 1000000000;
+	ts.tv_nsec = wall % 1000000000;
+	if (clock_settime(CLOCK_REALTIME, &ts) == -1)
+		warn("failed to set time after resume");
+
+	/* don't let the copies share random numbers */
+	rumpuser_random_reseed();
+	if ((fd = open("/dev/random", O_WRONLY)) != -1) {
+		memset(&seed, 0, sizeof(seed));
+		seed.now = now;
+		bmk_platform_getentropy(seed.ent, sizeof(seed.ent));
+		write(fd, &seed, sizeof(seed));
+		close(fd);
+	}
+}
+
 void
 rumprun_boot(char *cmdline)
 {
@@ -88,12 +154,19 @@ rumprun_boot(char *cmdline)
 	char *sysproxy;
 	int rv, x;
 
+	bmk_core_bootphase("bmk");
+
+	/* bad accesses to file mappings terminate the program */
+	bmk_vm_setsegv(rumprun_segv);
+
 	rump_boot_setsigmodel(RUMP_SIGMODEL_IGNORE);
 	rump_init();
+	bmk_core_bootphase("rump_init");
 
 	/* mount /tmp before we let any userspace bits run */
 	rump_sys_mount(MOUNT_TMPFS, "/tmp", 0, &ta, sizeof(ta));
 	tmpfserrno = errno;
+	bmk_core_bootphase("tmpfs");
 
 	/*
 	 * XXX: _netbsd_userlevel_init() should technically be called
@@ -107,6 +180,7 @@ rumprun_boot(char *cmdline)
 	 */
 	rumprun_lwp_init();
 	_netbsd_userlevel_init();
+	bmk_core_bootphase("libc");
 
 	/* print tmpfs result only after we bootstrapped userspace */
 	if (tmpfserrno == 0) {
@@ -124,13 +198,22 @@ rumprun_boot(char *cmdline)
 	x = 0;
 	sysctlbyname("net.inet.ip.dad_count", NULL, NULL, &x, sizeof(x));
 
+	/*
+	 * Network interfaces are configured in the background while
+	 * the rest of the config is processed.  Wait for them before
+	 * anything which might want to use the network.
+	 */
 	rumprun_config(cmdline);
+	bmk_core_bootphase("config");
+	rumprun_config_netwait();
+	bmk_core_bootphase("net");
 
 	sysproxy = getenv("RUMPRUN_SYSPROXY");
 	if (sysproxy) {
 		if ((rv = rump_init_server(sysproxy)) != 0)
 			err(1, "failed to init sysproxy at %s", sysproxy);
 		printf("sysproxy listening at: %s\n", sysproxy);
+		bmk_core_bootphase("sysproxy");
 	}
 
 	/*
@@ -142,6 +225,11 @@ rumprun_boot(char *cmdline)
 	pthread_mutex_init(&w_mtx, NULL);
 	pthread_cond_init(&w_cv, NULL);
 
+	bootphases_print();
+
+	if (getenv("RUMPRUN_SNAPSHOT"))
+		snapshot();
+
 	rumprun_cold = 0;
 }
 
@@ -24,6 +24,7 @@
  */
 
 #include <sys/cdefs.h>
+#include <sys/idtype.h>
 #include <sys/resource.h>
 #include <sys/time.h>
 
@@ -38,8 +39,18 @@
 #include <time.h>
 #include <unistd.h>
 
+#include <rump/rump_syscalls.h>
+
+#include <bmk-core/core.h>
+#include <bmk-core/pgalloc.h>
+#include <bmk-core/platform.h>
+#include <bmk-core/printf.h>
+#include <bmk-core/sched.h>
+
 #include <rumprun-base/rumprun.h>
 
+#include "rumprun-private.h"
+
 void __dead
 _exit(int eval)
 {
@@ -59,6 +70,24 @@ _exit(int eval)
 	pthread_exit((void *)(uintptr_t)eval);
 }
 
+/*
+ * Called in the context of a thread which made an access to a file
+ * mapping that cannot be satisfied, e.g. a write to a read-only
+ * mapping or a touch of an unmapped page.  There are no signals to
+ * deliver, so exit the way the default SIGSEGV action would.  The
+ * thread may have faulted with stdio locked, hence bmk_printf().
+ */
+void
+rumprun_segv(unsigned long va, int write)
+{
+
+	bmk_printf("\n=== %s fault at 0x%lx, terminating ===\n",
+	    write ? "write" : "read", va);
+	if (__predict_false(rumprun_cold))
+		bmk_platform_halt("fault during bootstrap");
+	pthread_exit((void *)(uintptr_t)(128 + SIGSEGV));
+}
+
 /* XXX: manual proto.  plug into libc internals some other day */
 int     ____sigtimedwait50(const sigset_t * __restrict,
     siginfo_t * __restrict, struct timespec * __restrict);
@@ -79,29 +108,220 @@ ____sigtimedwait50(const sigset_t *set, siginfo_t *info,
 	return -1;
 }
 
+/*
+ * Resource usage as seen by the bmk scheduler and page allocator.
+ * There is only one process, so RUSAGE_SELF covers the whole image:
+ * ru_utime is the time spent in application threads, including the
+ * system calls they make, and ru_stime the time spent in the rump
+ * kernel's own threads (interrupts, softints, workqueues and so on).
+ * Threads are never preempted, so all context switches are voluntary.
+ * ru_maxrss is the peak amount of memory allocated from the page
+ * allocator, which all other allocators draw from.
+ */
+static void
+ns2tv(long long ns, struct timeval *tv)
+{
+
+	tv->tv_sec = ns / 1000000000;
+	tv->tv_usec = (ns % 1000000000) / 1000;
+}
+
 /* XXX: manual proto.  plug into libc internals some other day */
 int __getrusage50(int, struct rusage *);
 int
 __getrusage50(int who, struct rusage *usage)
 {
+	struct bmk_sched_stats st;
+	long long appruntime;
+	unsigned long appnswitch, totalkb, usedkb, maxusedkb;
 
-	/* We fake something.  We should query the scheduler some day */
 	memset(usage, 0, sizeof(*usage));
-	if (who == RUSAGE_SELF) {
-		usage->ru_utime.tv_sec = 1;
-		usage->ru_utime.tv_usec = 1;
-		usage->ru_stime.tv_sec = 1;
-		usage->ru_stime.tv_usec = 1;
+	switch (who) {
+	case RUSAGE_SELF:
+		break;
+	case RUSAGE_CHILDREN:
+		/* no children, ever */
+		return 0;
+	default:
+		errno = EINVAL;
+		return -1;
+	}
+
+	/* take the totals last so that they cover the application part */
+	rumprun_lwp_gettotals(&appruntime, &appnswitch);
+	bmk_sched_getprocstats(&st, NULL);
+	if (st.bss_runtime < appruntime)
+		st.bss_runtime = appruntime;
+
+	ns2tv(appruntime, &usage->ru_utime);
+	ns2tv(st.bss_runtime - appruntime, &usage->ru_stime);
+	usage->ru_nvcsw = st.bss_nswitch;
+
+	bmk_pgalloc_usage(&totalkb, &usedkb, &maxusedkb);
+	usage->ru_maxrss = maxusedkb;
+
+	return 0;
+}
+
+/*
+ * CPU time clocks.  The rump kernel does not know how much cpu time
+ * our threads use, so they are handled here and the rest of the
+ * clocks are passed on to the rump kernel.  Like in NetBSD, the low
+ * bits of the clock id are the pid or lwp id, 0 meaning "self".
+ */
+#define CPUCLOCK_ID_MASK \
+    (~(clockid_t)(CLOCK_THREAD_CPUTIME_ID|CLOCK_PROCESS_CPUTIME_ID))
+
+/*
+ * Fast path for the common clocks.  Both are the bmk monotonic clock,
+ * which is also what _lwp_park() sleeps against, plus an offset to the
+ * rump kernel's idea of the time.  Neither requires entering the rump
+ * kernel except when an offset is computed.  The CLOCK_MONOTONIC
+ * offset accounts for the rump kernel's uptime starting at rump_init()
+ * rather than at platform start, and is fixed.  The CLOCK_REALTIME
+ * offset is cached for RTOFFSET_MAXAGE so that adjustments made inside
+ * the rump kernel (e.g. by adjtime) are picked up, and dropped whenever
+ * the time is set through us.
+ */
+#define RTOFFSET_MAXAGE (1000*1000*1000ULL)
+static long long rtoffset;
+static bmk_time_t rtoffset_stamp;
+static int rtoffset_valid;
+static long long monooffset;
+static int monooffset_valid;
+
+long long
+rumprun_clock_monooffset(void)
+{
+	struct timespec ts;
+
+	if (monooffset_valid)
+		return monooffset;
+
+	if (rump_sys_clock_gettime(CLOCK_MONOTONIC, &ts) == -1)
+		return 0;
+	monooffset = ts.tv_sec*1000*1000*1000LL + ts.tv_nsec
+	    - bmk_platform_cpu_clock_monotonic();
+	monooffset_valid = 1;
+
+	return monooffset;
+}
+
+long long
+rumprun_clock_rtoffset(void)
+{
+	struct timespec ts;
+	bmk_time_t now;
+
+	now = bmk_platform_cpu_clock_monotonic();
+	if (rtoffset_valid && now - rtoffset_stamp < RTOFFSET_MAXAGE)
+		return rtoffset;
+
+	if (rump_sys_clock_gettime(CLOCK_REALTIME, &ts) == -1)
+		return bmk_platform_cpu_clock_epochoffset();
+	now = bmk_platform_cpu_clock_monotonic();
+
+	rtoffset = ts.tv_sec*1000*1000*1000LL + ts.tv_nsec - now;
+	rtoffset_stamp = now;
+	rtoffset_valid = 1;
+
+	return rtoffset;
+}
+
+/* XXX: manual proto.  plug into libc internals some other day */
+int __clock_gettime50(clockid_t, struct timespec *);
+int
+__clock_gettime50(clockid_t clock_id, struct timespec *ts)
+{
+	struct bmk_sched_stats st;
+	struct rumprun_lwpstats rls;
+	long long ns;
+	int lid, error;
+
+	if (clock_id & CLOCK_PROCESS_CPUTIME_ID) {
+		bmk_sched_getprocstats(&st, NULL);
+		ns = st.bss_runtime;
+	} else if (clock_id & CLOCK_THREAD_CPUTIME_ID) {
+		if ((lid = clock_id & CPUCLOCK_ID_MASK) == 0)
+			lid = _lwp_self();
+		if ((error = rumprun_lwp_getstats(lid, &rls)) != 0) {
+			errno = error;
+			return -1;
+		}
+		ns = rls.rls_runtime;
+	} else if (clock_id == CLOCK_MONOTONIC) {
+		ns = rumprun_clock_monooffset()
+		    + bmk_platform_cpu_clock_monotonic();
+	} else if (clock_id == CLOCK_REALTIME) {
+		ns = rumprun_clock_rtoffset()
+		    + bmk_platform_cpu_clock_monotonic();
+	} else {
+		return rump_sys_clock_gettime(clock_id, ts);
 	}
 
-	usage->ru_maxrss = 1024;
-	usage->ru_ixrss = 1024;
-	usage->ru_idrss = 1024;
-	usage->ru_isrss = 1024;
+	ts->tv_sec = ns / 1000000000;
+	ts->tv_nsec = ns % 1000000000;
+	return 0;
+}
+
+/* XXX: manual proto.  plug into libc internals some other day */
+int __gettimeofday50(struct timeval *, void *);
+int
+__gettimeofday50(struct timeval *tv, void *tzp)
+{
+
+	if (tv)
+		ns2tv(rumprun_clock_rtoffset()
+		    + bmk_platform_cpu_clock_monotonic(), tv);
+	if (tzp)
+		memset(tzp, 0, sizeof(struct timezone));
+	return 0;
+}
+
+/* XXX: manual proto.  plug into libc internals some other day */
+int __clock_settime50(clockid_t, const struct timespec *);
+int
+__clock_settime50(clockid_t clock_id, const struct timespec *ts)
+{
+
+	rtoffset_valid = 0;
+	return rump_sys_clock_settime(clock_id, ts);
+}
+
+/* XXX: manual proto.  plug into libc internals some other day */
+int __settimeofday50(const struct timeval *, const void *);
+int
+__settimeofday50(const struct timeval *tv, const void *tzp)
+{
+
+	rtoffset_valid = 0;
+	return rump_sys_settimeofday(tv, tzp);
+}
 
-	usage->ru_nvcsw = 1;
-	usage->ru_nivcsw = 1;
+int
+clock_getcpuclockid2(idtype_t idtype, id_t id, clockid_t *clock_id)
+{
+	struct rumprun_lwpstats rls;
 
-	/* XXX: wrong in many ways */
-	return ENOTSUP;
+	switch (idtype) {
+	case P_PID:
+		if (id != 0 && id != getpid()) {
+			errno = ESRCH;
+			return -1;
+		}
+		*clock_id = CLOCK_PROCESS_CPUTIME_ID;
+		return 0;
+	case P_LWPID:
+		if (id == 0)
+			id = _lwp_self();
+		if (rumprun_lwp_getstats(id, &rls) != 0) {
+			errno = ESRCH;
+			return -1;
+		}
+		*clock_id = CLOCK_THREAD_CPUTIME_ID | id;
+		return 0;
+	default:
+		errno = EINVAL;
+		return -1;
+	}
 }
@@ -40,7 +40,9 @@
 __RCSID("$NetBSD: rumpuser_sp.c,v 1.68 2014/12/08 00:12:03 justin Exp $");
 #endif /* !lint */
 
+#include <sys/param.h>
 #include <sys/types.h>
+#include <sys/event.h>
 #include <sys/mman.h>
 #include <sys/socket.h>
 
@@ -182,7 +184,8 @@ enum {	RUMPSP_HANDSHAKE,
 	RUMPSP_COPYOUT, RUMPSP_COPYOUTSTR,
 	RUMPSP_ANONMMAP,
 	RUMPSP_PREFORK,
-	RUMPSP_RAISE };
+	RUMPSP_RAISE,
+	RUMPSP_SYSCALLV };
 
 enum { HANDSHAKE_GUEST, HANDSHAKE_AUTH, HANDSHAKE_FORK, HANDSHAKE_EXEC };
 
@@ -262,6 +265,35 @@ struct rsp_sysresp {
 	register_t rsys_retval[2];
 };
 
+/*
+ * Batched syscalls (protocol 0.5).  A RUMPSP_SYSCALLV request is a
+ * rsp_batchhdr followed by rbh_nsys syscalls and rbh_nprefetch
+ * rsp_copydata blocks carrying memory the client expects the syscalls
+ * to copy in.  Each syscall and copydata block is padded to RSP_ALIGN.
+ * Copyins within a prefetched block are served from the request instead
+ * of doing a RUMPSP_COPYIN round trip, and other copyins still go to
+ * the client.  The response carries an rsp_sysresp for every
+ * syscall executed.  Execution stops after a failed syscall which has
+ * RUMPSP_BATCH_STOPONERR set, so the response can contain fewer
+ * entries than the request.  If the batch cannot be run at all, the
+ * response is a single entry carrying the error.
+ */
+struct rsp_batchhdr {
+	uint32_t rbh_nsys;
+	uint32_t rbh_nprefetch;
+};
+
+struct rsp_batchsys {
+	uint32_t rbs_sysnum;
+	uint32_t rbs_flags;
+	uint64_t rbs_argslen;
+	uint8_t rbs_args[0];
+};
+#define RUMPSP_BATCH_STOPONERR	0x01
+
+#define RUMPSP_MAXBATCH 64
+#define RSP_ALIGN(x) (((x) + 7) & ~(size_t)7)
+
 struct handshake_fork {
 	uint32_t rf_auth[4];
 	int rf_cancel;
@@ -292,17 +324,17 @@ struct spclient {
 	pid_t spc_pid;
 
 	TAILQ_HEAD(, respwait) spc_respwait;
+	LIST_ENTRY(spclient) spc_entries;
 
 	/* rest of the fields are zeroed upon disconnect */
-#define SPC_ZEROFF offsetof(struct spclient, spc_pfd)
-	struct pollfd *spc_pfd;
-
+#define SPC_ZEROFF offsetof(struct spclient, spc_hdr)
 	struct rsp_hdr spc_hdr;
 	uint8_t *spc_buf;
 	size_t spc_off;
 
 	uint64_t spc_nextreq;
 	uint64_t spc_syscallreq;
+	int spc_syscallbatch;
 	uint64_t spc_generation;
 	int spc_ostatus, spc_istatus;
 	int spc_reconnecting;
@@ -872,8 +904,17 @@ parseurl(const char *url, struct sockaddr **sap, unsigned *idxp,
 	return 0;
 }
 
+/*
+ * The server is driven by a kqueue: client descriptors are registered
+ * once when the connection is accepted and carry their spclient as
+ * udata, so the mainloop never rebuilds or scans a descriptor list.
+ * Client structures are allocated on demand and recycled via a
+ * freelist.  Requests are executed by a pool of IDLEWORKER threads
+ * started with the server.  If all of them are blocked in syscalls,
+ * temporary extra workers are created, up to MAXWORKER in total.
+ */
 #ifndef MAXCLI
-#define MAXCLI 256
+#define MAXCLI 4096
 #endif
 #ifndef MAXWORKER
 #define MAXWORKER 128
@@ -881,59 +922,30 @@ parseurl(const char *url, struct sockaddr **sap, unsigned *idxp,
 #ifndef IDLEWORKER
 #define IDLEWORKER 16
 #endif
+/* kevents fetched per mainloop round */
+#ifndef NEVENT
+#define NEVENT 64
+#endif
+/* max requests read from one client before servicing others */
+#ifndef MAXPIPELINE
+#define MAXPIPELINE 16
+#endif
 int rumpsp_maxworker = MAXWORKER;
 int rumpsp_idleworker = IDLEWORKER;
 
-static struct pollfd pfdlist[MAXCLI];
-static struct spclient spclist[MAXCLI];
-static unsigned int disco;
+static int spkq = -1;
+static int spsock = -1;
 static volatile int spfini;
 
+static pthread_mutex_t spcmtx = PTHREAD_MUTEX_INITIALIZER;
+static LIST_HEAD(, spclient) spclients = LIST_HEAD_INITIALIZER(spclients);
+static LIST_HEAD(, spclient) spcfreelist = LIST_HEAD_INITIALIZER(spcfreelist);
+static unsigned int nspc;
+
 static char banner[MAXBANNER];
 
 #define PROTOMAJOR 0
-#define PROTOMINOR 4
-
-
-/* how to use atomic ops on Linux? */
-#if defined(__linux__) || defined(__APPLE__) || defined(__CYGWIN__) || defined(__OpenBSD__)
-static pthread_mutex_t discomtx = PTHREAD_MUTEX_INITIALIZER;
-
-static void
-signaldisco(void)
-{
-
-	pthread_mutex_lock(&discomtx);
-	disco++;
-	pthread_mutex_unlock(&discomtx);
-}
-
-static unsigned int
-getdisco(void)
-{
-	unsigned int discocnt;
-
-	pthread_mutex_lock(&discomtx);
-	discocnt = disco;
-	disco = 0;
-	pthread_mutex_unlock(&discomtx);
-
-	return discocnt;
-}
-
-#elif defined(__FreeBSD__) || defined(__DragonFly__)
-
-#include <machine/atomic.h>
-#define signaldisco()	atomic_add_int(&disco, 1)
-#define getdisco()	atomic_readandclear_int(&disco)
-
-#else /* NetBSD */
-
-#include <sys/atomic.h>
-#define signaldisco() atomic_inc_uint(&disco)
-#define getdisco() atomic_swap_uint(&disco, 0)
-
-#endif
+#define PROTOMINOR 5
 
 
 struct prefork {
@@ -1319,6 +1331,215 @@ send_raise_req(struct spclient *spc, int signo)
 	return rv;
 }
 
+/*
+ * Context of the syscall a worker is currently executing, found
+ * through spworkkey.  Copyouts are not sent to the client one by
+ * one but queued here and written together with the syscall response
+ * in one message.  The queue is flushed before anything else is sent
+ * to the client on behalf of the syscall, so the client still sees
+ * copyouts in the order they were made.  Prefetched copyin data from
+ * a batch request is updated by copyouts to the same range.
+ */
+#define SPCOPYOUT_MAX		32
+#define SPCOPYOUT_MAXBYTES	(64*1024)
+
+struct spcopyout {
+	struct rsp_hdr sco_hdr;
+	struct rsp_copydata sco_copydata;
+	void *sco_data;
+};
+
+struct spworkctx {
+	struct spclient *swc_spc;
+
+	uint8_t *swc_pf;
+	size_t swc_pflen;
+
+	struct spcopyout swc_co[SPCOPYOUT_MAX];
+	unsigned int swc_nco;
+	size_t swc_cobytes;
+
+	/* for a batch, the responses and the index of the current call */
+	struct rsp_sysresp *swc_resp;
+	size_t swc_curresp;
+};
+static pthread_key_t spworkkey;
+
+static struct spworkctx *
+spwork_get(struct spclient *spc)
+{
+	struct spworkctx *swc;
+
+	swc = pthread_getspecific(spworkkey);
+	if (swc == NULL || swc->swc_spc != spc)
+		return NULL;
+	return swc;
+}
+
+/*
+ * Send queued copyouts, followed by the iovecs in tail (if any).
+ */
+static int
+spwork_flush(struct spworkctx *swc, struct iovec *tail, size_t ntail)
+{
+	struct iovec iov[3*SPCOPYOUT_MAX + 2];
+	struct spcopyout *sco;
+	unsigned int i;
+	size_t n = 0;
+	int rv;
+
+	_DIAGASSERT(ntail <= 2);
+
+	for (i = 0; i < swc->swc_nco; i++) {
+		sco = &swc->swc_co[i];
+		IOVPUT(iov[n++], sco->sco_hdr);
+		IOVPUT(iov[n++], sco->sco_copydata);
+		IOVPUT_WITHSIZE(iov[n++], sco->sco_data,
+		    sco->sco_copydata.rcp_len);
+	}
+	for (i = 0; i < ntail; i++)
+		iov[n++] = tail[i];
+	if (n == 0)
+		return 0;
+
+	sendlock(swc->swc_spc);
+	rv = dosend(swc->swc_spc, iov, n);
+	sendunlock(swc->swc_spc);
+
+	for (i = 0; i < swc->swc_nco; i++)
+		free(swc->swc_co[i].sco_data);
+	swc->swc_nco = 0;
+	swc->swc_cobytes = 0;
+
+	return rv;
+}
+
+static int
+spwork_copyout(struct spworkctx *swc, const void *remaddr,
+	const void *data, size_t dlen)
+{
+	struct spcopyout *sco;
+	void *p;
+	int rv;
+
+	if (swc->swc_nco == SPCOPYOUT_MAX
+	    || swc->swc_cobytes + dlen > SPCOPYOUT_MAXBYTES) {
+		if ((rv = spwork_flush(swc, NULL, 0)) != 0)
+			return rv;
+	}
+
+	/* large copyouts are not worth copying a second time */
+	if (dlen > SPCOPYOUT_MAXBYTES/2 || (p = malloc(dlen)) == NULL) {
+		if ((rv = spwork_flush(swc, NULL, 0)) != 0)
+			return rv;
+		return send_copyout_req(swc->swc_spc, remaddr, data, dlen);
+	}
+	memcpy(p, data, dlen);
+
+	sco = &swc->swc_co[swc->swc_nco++];
+	sco->sco_hdr.rsp_len = sizeof(sco->sco_hdr)
+	    + sizeof(sco->sco_copydata) + dlen;
+	sco->sco_hdr.rsp_reqno = nextreq(swc->swc_spc);
+	sco->sco_hdr.rsp_class = RUMPSP_REQ;
+	sco->sco_hdr.rsp_type = RUMPSP_COPYOUT;
+	sco->sco_hdr.rsp_sysnum = 0;
+	sco->sco_copydata.rcp_addr = __UNCONST(remaddr);
+	sco->sco_copydata.rcp_len = dlen;
+	sco->sco_data = p;
+	swc->swc_cobytes += dlen;
+
+	return 0;
+}
+
+/*
+ * Serve a copyin from prefetched data.  The blocks were validated
+ * when the request was parsed.  Returns 1 if the range was found.
+ */
+static int
+spwork_prefetched(struct spworkctx *swc, const void *remaddr, void *laddr,
+	size_t *len, int wantstr)
+{
+	struct rsp_copydata *rcp;
+	uintptr_t raddr = (uintptr_t)remaddr, base;
+	uint8_t *p, *src, *nul;
+	size_t avail, n;
+
+	for (p = swc->swc_pf; p < swc->swc_pf + swc->swc_pflen;
+	    p += RSP_ALIGN(sizeof(*rcp) + rcp->rcp_len)) {
+		rcp = (void *)p;
+		base = (uintptr_t)rcp->rcp_addr;
+		if (raddr < base || raddr - base >= rcp->rcp_len)
+			continue;
+
+		src = rcp->rcp_data + (raddr - base);
+		avail = rcp->rcp_len - (raddr - base);
+		if (wantstr) {
+			/* let the client decide about unterminated strings */
+			n = MIN(*len, avail);
+			if ((nul = memchr(src, '\0', n)) == NULL)
+				return 0;
+			*len = (size_t)(nul - src) + 1;
+		} else if (*len > avail) {
+			return 0;
+		}
+		memcpy(laddr, src, *len);
+		return 1;
+	}
+
+	return 0;
+}
+
+static void
+spwork_pfupdate(struct spworkctx *swc, const void *remaddr,
+	const void *data, size_t dlen)
+{
+	struct rsp_copydata *rcp;
+	uintptr_t raddr = (uintptr_t)remaddr, base, start, end;
+	uint8_t *p;
+
+	for (p = swc->swc_pf; p < swc->swc_pf + swc->swc_pflen;
+	    p += RSP_ALIGN(sizeof(*rcp) + rcp->rcp_len)) {
+		rcp = (void *)p;
+		base = (uintptr_t)rcp->rcp_addr;
+		start = MAX(raddr, base);
+		end = MIN(raddr + dlen, base + rcp->rcp_len);
+		if (start >= end)
+			continue;
+		memcpy(rcp->rcp_data + (start - base),
+		    (const uint8_t *)data + (start - raddr), end - start);
+	}
+}
+
+static int
+send_batch_resp(struct spworkctx *swc, uint64_t reqno, int type,
+	struct rsp_sysresp *resp, size_t nresp)
+{
+	struct rsp_hdr rhdr;
+	struct iovec iov[2];
+
+	rhdr.rsp_len = sizeof(rhdr) + nresp*sizeof(*resp);
+	rhdr.rsp_reqno = reqno;
+	rhdr.rsp_class = RUMPSP_RESP;
+	rhdr.rsp_type = type;
+	rhdr.rsp_sysnum = 0;
+
+	IOVPUT(iov[0], rhdr);
+	IOVPUT_WITHSIZE(iov[1], resp, nresp*sizeof(*resp));
+
+	return spwork_flush(swc, iov, __arraycount(iov));
+}
+
+static void
+spcdealloc(struct spclient *spc)
+{
+
+	pthread_mutex_lock(&spcmtx);
+	LIST_REMOVE(spc, spc_entries);
+	LIST_INSERT_HEAD(&spcfreelist, spc, spc_entries);
+	nspc--;
+	pthread_mutex_unlock(&spcmtx);
+}
+
 static void
 spcref(struct spclient *spc)
 {
@@ -1357,19 +1578,48 @@ spcrelease(struct spclient *spc)
 	spc->spc_fd = -1;
 	spc->spc_state = SPCSTATE_NEW;
 
-	signaldisco();
+	spcdealloc(spc);
+}
+
+static struct spclient *
+spcalloc(void)
+{
+	struct spclient *spc;
+
+	pthread_mutex_lock(&spcmtx);
+	if (nspc >= MAXCLI) {
+		spc = NULL;
+		goto out;
+	}
+	if ((spc = LIST_FIRST(&spcfreelist)) != NULL) {
+		LIST_REMOVE(spc, spc_entries);
+	} else {
+		if ((spc = calloc(1, sizeof(*spc))) == NULL)
+			goto out;
+		pthread_mutex_init(&spc->spc_mtx, NULL);
+		pthread_cond_init(&spc->spc_cv, NULL);
+		spc->spc_fd = -1;
+	}
+	LIST_INSERT_HEAD(&spclients, spc, spc_entries);
+	nspc++;
+
+ out:
+	pthread_mutex_unlock(&spcmtx);
+	return spc;
 }
 
 static void
-serv_handledisco(unsigned int idx)
+serv_handledisco(struct spclient *spc)
 {
-	struct spclient *spc = &spclist[idx];
+	struct kevent kev;
 	int dolwpexit;
 
-	DPRINTF(("rump_sp: disconnecting [%u]\n", idx));
+	DPRINTF(("rump_sp: disconnecting fd %d\n", spc->spc_fd));
+
+	/* stop listening.  the descriptor stays open until spcrelease() */
+	EV_SET(&kev, spc->spc_fd, EVFILT_READ, EV_DELETE, 0, 0, 0);
+	(void)kevent(spkq, &kev, 1, NULL, 0, NULL);
 
-	pfdlist[idx].fd = -1;
-	pfdlist[idx].revents = 0;
 	pthread_mutex_lock(&spc->spc_mtx);
 	spc->spc_state = SPCSTATE_DYING;
 	kickall(spc);
@@ -1397,89 +1647,76 @@ serv_handledisco(unsigned int idx)
 static void
 serv_shutdown(void)
 {
-	struct spclient *spc;
-	unsigned int i;
+	struct spclient *spc, *spc_next;
 
-	for (i = 1; i < MAXCLI; i++) {
-		spc = &spclist[i];
-		if (spc->spc_fd == -1)
+	for (spc = LIST_FIRST(&spclients); spc; spc = spc_next) {
+		spc_next = LIST_NEXT(spc, spc_entries);
+		if (spc->spc_fd == -1 || spc->spc_state == SPCSTATE_DYING)
 			continue;
 
 		shutdown(spc->spc_fd, SHUT_RDWR);
-		serv_handledisco(i);
+		serv_handledisco(spc);
 
 		spcrelease(spc);
 	}
 }
 
-static unsigned
-serv_handleconn(int fd, connecthook_fn connhook, int busy)
+static void
+serv_handleconn(int fd, connecthook_fn connhook)
 {
 	struct sockaddr_storage ss;
 	socklen_t sl = sizeof(ss);
+	struct spclient *spc;
+	struct kevent kev;
 	int newfd, flags;
-	unsigned i;
 
 	/*LINTED: cast ok */
 	newfd = accept(fd, (struct sockaddr *)&ss, &sl);
 	if (newfd == -1)
-		return 0;
+		return;
 
-	if (busy) {
+	if ((spc = spcalloc()) == NULL) {
 		close(newfd); /* EBUSY */
-		return 0;
+		return;
 	}
 
 	flags = fcntl(newfd, F_GETFL, 0);
-	if (fcntl(newfd, F_SETFL, flags | O_NONBLOCK) == -1) {
-		close(newfd);
-		return 0;
-	}
+	if (fcntl(newfd, F_SETFL, flags | O_NONBLOCK) == -1)
+		goto fail;
 
-	if (connhook(newfd) != 0) {
-		close(newfd);
-		return 0;
-	}
+	if (connhook(newfd) != 0)
+		goto fail;
 
 	/* write out a banner for the client */
 	if (send(newfd, banner, strlen(banner), MSG_NOSIGNAL)
-	    != (ssize_t)strlen(banner)) {
-		close(newfd);
-		return 0;
-	}
+	    != (ssize_t)strlen(banner))
+		goto fail;
 
-	/* find empty slot the simple way */
-	for (i = 0; i < MAXCLI; i++) {
-		if (pfdlist[i].fd == -1 && spclist[i].spc_state == SPCSTATE_NEW)
-			break;
-	}
+	spc->spc_fd = newfd;
+	spc->spc_istatus = SPCSTATUS_BUSY; /* dedicated receiver */
+	spc->spc_refcnt = 1;
 
-	/*
-	 * Although not finding a slot is impossible (cf. how this routine
-	 * is called), the compiler can still think that i == MAXCLI
-	 * if this code is either compiled with NDEBUG or the platform
-	 * does not use __dead for assert().  Therefore, add an explicit
-	 * check to avoid an array-bounds error.
-	 */
-	/* assert(i < MAXCLI); */
-	if (i == MAXCLI)
-		abort();
-
-	pfdlist[i].fd = newfd;
-	spclist[i].spc_fd = newfd;
-	spclist[i].spc_istatus = SPCSTATUS_BUSY; /* dedicated receiver */
-	spclist[i].spc_refcnt = 1;
+	TAILQ_INIT(&spc->spc_respwait);
 
-	TAILQ_INIT(&spclist[i].spc_respwait);
+	EV_SET(&kev, newfd, EVFILT_READ, EV_ADD, 0, 0, (intptr_t)spc);
+	if (kevent(spkq, &kev, 1, NULL, 0, NULL) == -1) {
+		spc->spc_fd = -1;
+		goto fail;
+	}
 
-	DPRINTF(("rump_sp: added new connection fd %d at idx %u\n", newfd, i));
+	DPRINTF(("rump_sp: added new connection fd %d at %p\n", newfd, spc));
+	return;
 
-	return i;
+ fail:
+	close(newfd);
+	spcdealloc(spc);
 }
 
 static void
 serv_handlesyscall(struct spclient *spc, struct rsp_hdr *rhdr, uint8_t *data)
 {
+	struct spworkctx swc;
+	struct rsp_sysresp resp;
 	register_t retval[2] = {0, 0};
 	int rv, sysnum;
 
@@ -1492,6 +1729,10 @@ serv_handlesyscall(struct spclient *spc, struct rsp_hdr *rhdr, uint8_t *data)
 		send_syscall_resp(spc, rhdr->rsp_reqno, rv, retval);
 		return;
 	}
+	memset(&swc, 0, sizeof(swc));
+	swc.swc_spc = spc;
+	pthread_setspecific(spworkkey, &swc);
+
 	spc->spc_syscallreq = rhdr->rsp_reqno;
 	rv = rumpsyscall(sysnum, data, retval);
 	spc->spc_syscallreq = 0;
@@ -1500,7 +1741,118 @@ serv_handlesyscall(struct spclient *spc, struct rsp_hdr *rhdr, uint8_t *data)
 	DPRINTF(("rump_sp: got return value %d & %d/%d\n",
 	    rv, retval[0], retval[1]));
 
-	send_syscall_resp(spc, rhdr->rsp_reqno, rv, retval);
+	resp.rsys_error = rv;
+	memcpy(resp.rsys_retval, retval, sizeof(resp.rsys_retval));
+	send_batch_resp(&swc, rhdr->rsp_reqno, RUMPSP_SYSCALL, &resp, 1);
+	pthread_setspecific(spworkkey, NULL);
+}
+
+/*
+ * Check that a batch request is well-formed.  Returns the offset of
+ * the prefetch blocks, or 0 if the request is malformed.
+ */
+static size_t
+batch_validate(uint8_t *data, size_t len)
+{
+	struct rsp_batchhdr *rbh = (void *)data;
+	struct rsp_batchsys *rbs;
+	struct rsp_copydata *rcp;
+	size_t off, pfoff, n;
+	uint32_t i;
+
+	if (len < sizeof(*rbh))
+		return 0;
+	if (rbh->rbh_nsys == 0 || rbh->rbh_nsys > RUMPSP_MAXBATCH)
+		return 0;
+
+	off = sizeof(*rbh);
+	for (i = 0; i < rbh->rbh_nsys; i++) {
+		rbs = (void *)(data + off);
+		if (len - off < sizeof(*rbs)
+		    || rbs->rbs_argslen > len - off - sizeof(*rbs))
+			return 0;
+		n = RSP_ALIGN(sizeof(*rbs) + rbs->rbs_argslen);
+		if (n > len - off)
+			return 0;
+		off += n;
+	}
+
+	pfoff = off;
+	for (i = 0; i < rbh->rbh_nprefetch; i++) {
+		rcp = (void *)(data + off);
+		if (len - off < sizeof(*rcp)
+		    || rcp->rcp_len > len - off - sizeof(*rcp))
+			return 0;
+		n = RSP_ALIGN(sizeof(*rcp) + rcp->rcp_len);
+		if (n > len - off)
+			return 0;
+		off += n;
+	}
+	if (off != len)
+		return 0;
+
+	return pfoff;
+}
+
+static void
+serv_handlesyscallv(struct spclient *spc, struct rsp_hdr *rhdr, uint8_t *data)
+{
+	struct rsp_sysresp resp[RUMPSP_MAXBATCH];
+	struct spworkctx swc;
+	struct rsp_batchhdr *rbh = (void *)data;
+	struct rsp_batchsys *rbs;
+	register_t retval[2];
+	size_t off, pfoff;
+	uint32_t i;
+	int rv;
+
+	if ((pfoff = batch_validate(data, rhdr->rsp_len - HDRSZ)) == 0) {
+		send_error_resp(spc, rhdr->rsp_reqno,
+		    RUMPSP_ERR_MALFORMED_REQUEST);
+		return;
+	}
+
+	DPRINTF(("rump_sp: handling %u syscalls (%u prefetched) from "
+	    "client %d\n", rbh->rbh_nsys, rbh->rbh_nprefetch, spc->spc_pid));
+
+	memset(&swc, 0, sizeof(swc));
+	swc.swc_spc = spc;
+	if (__predict_false((rv = lwproc_newlwp(spc->spc_pid)) != 0)) {
+		resp[0].rsys_error = rv;
+		resp[0].rsys_retval[0] = -1;
+		resp[0].rsys_retval[1] = 0;
+		send_batch_resp(&swc, rhdr->rsp_reqno, RUMPSP_SYSCALLV,
+		    resp, 1);
+		return;
+	}
+	swc.swc_pf = data + pfoff;
+	swc.swc_pflen = rhdr->rsp_len - HDRSZ - pfoff;
+	swc.swc_resp = resp;
+	pthread_setspecific(spworkkey, &swc);
+
+	spc->spc_syscallreq = rhdr->rsp_reqno;
+	spc->spc_syscallbatch = 1;
+	off = sizeof(*rbh);
+	for (i = 0; i < rbh->rbh_nsys; i++) {
+		rbs = (void *)(data + off);
+		off += RSP_ALIGN(sizeof(*rbs) + rbs->rbs_argslen);
+		swc.swc_curresp = i;
+
+		retval[0] = retval[1] = 0;
+		rv = rumpsyscall((int)rbs->rbs_sysnum, rbs->rbs_args, retval);
+		resp[i].rsys_error = rv;
+		memcpy(resp[i].rsys_retval, retval, sizeof(retval));
+		if (rv && (rbs->rbs_flags & RUMPSP_BATCH_STOPONERR)) {
+			i++;
+			break;
+		}
+	}
+	spc->spc_syscallreq = 0;
+	spc->spc_syscallbatch = 0;
+	lwproc_release();
+
+	send_batch_resp(&swc, rhdr->rsp_reqno, RUMPSP_SYSCALLV, resp, i);
+	pthread_setspecific(spworkkey, NULL);
 }
 
 static void
@@ -1534,7 +1886,7 @@ serv_handleexec(struct spclient *spc, struct rsp_hdr *rhdr, char *comm)
 	send_handshake_resp(spc, rhdr->rsp_reqno, 0);
 }
 
-enum sbatype { SBA_SYSCALL, SBA_EXEC };
+enum sbatype { SBA_SYSCALL, SBA_SYSCALLV, SBA_EXEC };
 
 struct servbouncearg {
 	struct spclient *sba_spc;
@@ -1549,15 +1901,20 @@ static pthread_cond_t sbacv;
 static int nworker, idleworker, nwork;
 static TAILQ_HEAD(, servbouncearg) wrklist = TAILQ_HEAD_INITIALIZER(wrklist);
 
-/*ARGSUSED*/
+/*
+ * Workers started with the server (arg == NULL) live forever,
+ * extra ones (arg != NULL) exit once there are enough idle workers.
+ */
 static void *
 serv_workbouncer(void *arg)
 {
 	struct servbouncearg *sba;
+	int extra = arg != NULL;
 
 	for (;;) {
 		pthread_mutex_lock(&sbamtx);
-		if (__predict_false(idleworker - nwork >= rumpsp_idleworker)) {
+		if (__predict_false(extra
+		    && idleworker - nwork >= rumpsp_idleworker)) {
 			nworker--;
 			pthread_mutex_unlock(&sbamtx);
 			break;
@@ -1577,6 +1934,9 @@ serv_workbouncer(void *arg)
 		if (__predict_true(sba->sba_type == SBA_SYSCALL)) {
 			serv_handlesyscall(sba->sba_spc,
 			    &sba->sba_hdr, sba->sba_data);
+		} else if (sba->sba_type == SBA_SYSCALLV) {
+			serv_handlesyscallv(sba->sba_spc,
+			    &sba->sba_hdr, sba->sba_data);
 		} else {
 			_DIAGASSERT(sba->sba_type == SBA_EXEC);
 			serv_handleexec(sba->sba_spc, &sba->sba_hdr,
@@ -1594,11 +1954,20 @@ static int
 sp_copyin(void *arg, const void *raddr, void *laddr, size_t *len, int wantstr)
 {
 	struct spclient *spc = arg;
+	struct spworkctx *swc;
 	void *rdata = NULL; /* XXXuninit */
 	int rv, nlocks;
 
+	swc = spwork_get(spc);
+	if (swc && spwork_prefetched(swc, raddr, laddr, len, wantstr))
+		ET(0);
+
 	rumpkern_unsched(&nlocks, NULL);
 
+	/* the client must see our copyouts before it serves the copyin */
+	if (swc && (rv = spwork_flush(swc, NULL, 0)) != 0)
+		goto out;
+
 	rv = copyin_req(spc, raddr, len, wantstr, &rdata);
 	if (rv)
 		goto out;
@@ -1635,10 +2004,18 @@ static int
 sp_copyout(void *arg, const void *laddr, void *raddr, size_t dlen)
 {
 	struct spclient *spc = arg;
+	struct spworkctx *swc;
 	int nlocks, rv;
 
+	swc = spwork_get(spc);
+	if (swc)
+		spwork_pfupdate(swc, raddr, laddr, dlen);
+
 	rumpkern_unsched(&nlocks, NULL);
-	rv = send_copyout_req(spc, raddr, laddr, dlen);
+	if (swc)
+		rv = spwork_copyout(swc, raddr, laddr, dlen);
+	else
+		rv = send_copyout_req(spc, raddr, laddr, dlen);
 	rumpkern_sched(nlocks, NULL);
 
 	if (rv)
@@ -1668,12 +2045,18 @@ int
 rumpuser_sp_anonmmap(void *arg, size_t howmuch, void **addr)
 {
 	struct spclient *spc = arg;
+	struct spworkctx *swc;
 	void *resp, *rdata = NULL; /* XXXuninit */
 	int nlocks, rv;
 
 	rumpkern_unsched(&nlocks, NULL);
 
-	rv = anonmmap_req(spc, howmuch, &rdata);
+	if ((swc = spwork_get(spc)) != NULL)
+		rv = spwork_flush(swc, NULL, 0);
+	else
+		rv = 0;
+	if (rv == 0)
+		rv = anonmmap_req(spc, howmuch, &rdata);
 	if (rv) {
 		rv = EFAULT;
 		goto out;
@@ -1697,9 +2080,12 @@ int
 rumpuser_sp_raise(void *arg, int signo)
 {
 	struct spclient *spc = arg;
+	struct spworkctx *swc;
 	int rv, nlocks;
 
 	rumpkern_unsched(&nlocks, NULL);
+	if ((swc = spwork_get(spc)) != NULL)
+		(void)spwork_flush(swc, NULL, 0);
 	rv = send_raise_req(spc, signo);
 	rumpkern_sched(nlocks, NULL);
 
@@ -1747,7 +2133,7 @@ schedulework(struct spclient *spc, enum sbatype sba_type)
 		 * worker to pick up the syscall)
 		 */
 		if (pthread_create(&pt, &pattr_detached,
-		    serv_workbouncer, NULL) == 0) {
+		    serv_workbouncer, (void *)1) == 0) {
 			nworker++;
 		}
 	}
@@ -1984,6 +2370,11 @@ handlereq(struct spclient *spc)
 		return;
 	}
 
+	if (spc->spc_hdr.rsp_type == RUMPSP_SYSCALLV) {
+		schedulework(spc, SBA_SYSCALLV);
+		return;
+	}
+
 	if (__predict_false(spc->spc_hdr.rsp_type != RUMPSP_SYSCALL)) {
 		send_error_resp(spc, reqno, RUMPSP_ERR_MALFORMED_REQUEST);
 		spcfreebuf(spc);
@@ -1993,29 +2384,63 @@ handlereq(struct spclient *spc)
 	schedulework(spc, SBA_SYSCALL);
 }
 
+/*
+ * Read and dispatch all complete requests available from a client,
+ * so that a client pipelining requests gets them to the workers
+ * without a mainloop round per request.  The number of requests
+ * handled in one go is bounded to be fair to other clients.
+ */
+static void
+serv_handleinput(struct spclient *spc)
+{
+	int n;
+
+	for (n = 0; n < MAXPIPELINE; n++) {
+		switch (readframe(spc)) {
+		case 0:
+			return;
+		case -1:
+			serv_handledisco(spc);
+			return;
+		default:
+			switch (spc->spc_hdr.rsp_class) {
+			case RUMPSP_RESP:
+				kickwaiter(spc);
+				break;
+			case RUMPSP_REQ:
+				handlereq(spc);
+				break;
+			default:
+				send_error_resp(spc,
+				  spc->spc_hdr.rsp_reqno,
+				  RUMPSP_ERR_MALFORMED_REQUEST);
+				spcfreebuf(spc);
+				break;
+			}
+			break;
+		}
+	}
+}
+
 static void *
 spserver(void *arg)
 {
 	struct spservarg *sarg = arg;
+	struct kevent evlist[NEVENT], kev;
 	struct spclient *spc;
-	unsigned idx;
-	int seen;
-	int rv;
-	unsigned int nfds, maxidx;
-
-	for (idx = 0; idx < MAXCLI; idx++) {
-		pfdlist[idx].fd = -1;
-		pfdlist[idx].events = POLLIN;
+	pthread_t pt;
+	int i, rv;
 
-		spc = &spclist[idx];
-		pthread_mutex_init(&spc->spc_mtx, NULL);
-		pthread_cond_init(&spc->spc_cv, NULL);
-		spc->spc_fd = -1;
+	spsock = sarg->sps_sock;
+	if ((spkq = kqueue()) == -1) {
+		fprintf(stderr, "rump_spserver: kqueue failed: %d\n", errno);
+		return NULL;
+	}
+	EV_SET(&kev, spsock, EVFILT_READ, EV_ADD, 0, 0, 0);
+	if (kevent(spkq, &kev, 1, NULL, 0, NULL) == -1) {
+		fprintf(stderr, "rump_spserver: kevent failed: %d\n", errno);
+		return NULL;
 	}
-	pfdlist[0].fd = spclist[0].spc_fd = sarg->sps_sock;
-	pfdlist[0].events = POLLIN;
-	nfds = 1;
-	maxidx = 0;
 
 	pthread_attr_init(&pattr_detached);
 	pthread_attr_setdetachstate(&pattr_detached, PTHREAD_CREATE_DETACHED);
@@ -2026,91 +2451,46 @@ spserver(void *arg)
 	pthread_mutex_init(&sbamtx, NULL);
 	pthread_cond_init(&sbacv, NULL);
 
+	/* start the fixed worker pool */
+	for (i = 0; i < rumpsp_idleworker; i++) {
+		if (pthread_create(&pt, &pattr_detached,
+		    serv_workbouncer, NULL) != 0)
+			break;
+		pthread_mutex_lock(&sbamtx);
+		nworker++;
+		pthread_mutex_unlock(&sbamtx);
+	}
+
 	DPRINTF(("rump_sp: server mainloop\n"));
 
 	for (;;) {
-		int discoed;
-
-		/* g/c hangarounds (eventually) */
-		discoed = getdisco();
-		while (discoed--) {
-			nfds--;
-			idx = maxidx;
-			while (idx) {
-				if (pfdlist[idx].fd != -1) {
-					maxidx = idx;
-					break;
-				}
-				idx--;
-			}
-			DPRINTF(("rump_sp: set maxidx to [%u]\n",
-			    maxidx));
-		}
-
-		DPRINTF(("rump_sp: loop nfd %d\n", maxidx+1));
-		seen = 0;
-		rv = poll(pfdlist, maxidx+1, INFTIM);
-		assert(maxidx+1 <= MAXCLI);
-		assert(rv != 0);
+		rv = kevent(spkq, NULL, 0, evlist, NEVENT, NULL);
 		if (rv == -1) {
 			if (errno == EINTR)
 				continue;
-			fprintf(stderr, "rump_spserver: poll returned %d\n",
+			fprintf(stderr, "rump_spserver: kevent returned %d\n",
 			    errno);
 			break;
 		}
 
-		for (idx = 0; seen < rv && idx < MAXCLI; idx++) {
-			if ((pfdlist[idx].revents & POLLIN) == 0)
+		for (i = 0; i < rv; i++) {
+			spc = (void *)evlist[i].udata;
+			if (spc != NULL) {
+				DPRINTF(("rump_sp: activity at fd %d\n",
+				    spc->spc_fd));
+				serv_handleinput(spc);
 				continue;
+			}
 
-			seen++;
-			DPRINTF(("rump_sp: activity at [%u] %d/%d\n",
-			    idx, seen, rv));
-			if (idx > 0) {
-				spc = &spclist[idx];
-				DPRINTF(("rump_sp: mainloop read [%u]\n", idx));
-				switch (readframe(spc)) {
-				case 0:
-					break;
-				case -1:
-					serv_handledisco(idx);
-					break;
-				default:
-					switch (spc->spc_hdr.rsp_class) {
-					case RUMPSP_RESP:
-						kickwaiter(spc);
-						break;
-					case RUMPSP_REQ:
-						handlereq(spc);
-						break;
-					default:
-						send_error_resp(spc,
-						  spc->spc_hdr.rsp_reqno,
-						  RUMPSP_ERR_MALFORMED_REQUEST);
-						spcfreebuf(spc);
-						break;
-					}
-					break;
-				}
-
-			} else {
-				DPRINTF(("rump_sp: mainloop new connection\n"));
-
-				if (__predict_false(spfini)) {
-					close(spclist[0].spc_fd);
-					serv_shutdown();
-					goto out;
-				}
+			DPRINTF(("rump_sp: mainloop new connection\n"));
 
-				idx = serv_handleconn(pfdlist[0].fd,
-				    sarg->sps_connhook, nfds == MAXCLI);
-				if (idx)
-					nfds++;
-				if (idx > maxidx)
-					maxidx = idx;
-				DPRINTF(("rump_sp: maxid now %d\n", maxidx));
+			if (__predict_false(spfini)) {
+				close(spsock);
+				serv_shutdown();
+				goto out;
 			}
+
+			serv_handleconn(spsock, sarg->sps_connhook);
 		}
 	}
 
@@ -2177,6 +2557,11 @@ rumpuser_sp_init(const char *url,
 		goto out;
 	}
 
+	if ((error = pthread_key_create(&spworkkey, NULL)) != 0) {
+		fprintf(stderr, "rump_sp: cannot create worker key\n");
+		goto out;
+	}
+
 	if ((error = pthread_create(&pt, NULL, spserver, sarg)) != 0) {
 		fprintf(stderr, "rump_sp: cannot create wrkr thread\n");
 		goto out;
@@ -2191,6 +2576,8 @@ void
 rumpuser_sp_fini(void *arg)
 {
 	struct spclient *spc = arg;
+	struct spworkctx *swc, lswc;
+	struct rsp_sysresp *resp, lresp;
 	register_t retval[2] = {0, 0};
 	int nlocks;
 
@@ -2209,7 +2596,7 @@ rumpuser_sp_fini(void *arg)
 	rumpkern_unsched(&nlocks, NULL);
 	lwproc_newlwp(1);
 
-	if (spclist[0].spc_fd) {
+	if (spsock != -1) {
 		parsetab[cleanupidx].cleanup(cleanupsa);
 	}
 
@@ -2217,11 +2604,36 @@ rumpuser_sp_fini(void *arg)
 	 * stuff response into the socket, since the rump kernel container
 	 * is just about to exit
 	 */
-	if (spc && spc->spc_syscallreq)
-		send_syscall_resp(spc, spc->spc_syscallreq, 0, retval);
+	if (spc && spc->spc_syscallreq) {
+		swc = spwork_get(spc);
+		if (spc->spc_syscallbatch) {
+			/*
+			 * A batch is answered up to and including the
+			 * call which is exiting, or with just that call
+			 * if we are not in the context which ran it.
+			 */
+			if (swc) {
+				resp = &swc->swc_resp[swc->swc_curresp];
+			} else {
+				memset(&lswc, 0, sizeof(lswc));
+				lswc.swc_spc = spc;
+				lswc.swc_resp = resp = &lresp;
+				swc = &lswc;
+			}
+			resp->rsys_error = 0;
+			memcpy(resp->rsys_retval, retval, sizeof(retval));
+			send_batch_resp(swc, spc->spc_syscallreq,
+			    RUMPSP_SYSCALLV, swc->swc_resp,
+			    resp - swc->swc_resp + 1);
+		} else {
+			if (swc)
+				(void)spwork_flush(swc, NULL, 0);
+			send_syscall_resp(spc, spc->spc_syscallreq, 0, retval);
+		}
+	}
 
-	if (spclist[0].spc_fd) {
-		shutdown(spclist[0].spc_fd, SHUT_RDWR);
+	if (spsock != -1) {
+		shutdown(spsock, SHUT_RDWR);
 		spfini = 1;
 	}
 
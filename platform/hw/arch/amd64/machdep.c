@@ -25,8 +25,13 @@
 
 #include <hw/kernel.h>
 
+#include <bmk-core/core.h>
+#include <bmk-core/errno.h>
+#include <bmk-core/pgalloc.h>
 #include <bmk-core/printf.h>
 #include <bmk-core/sched.h>
+#include <bmk-core/string.h>
+#include <bmk-core/vm.h>
 
 /*
  * amd64 MD descriptors, assimilated from NetBSD
@@ -105,6 +110,149 @@ x86_fillgate(int num, void *fun, int ist)
 static char intrstack[4096];
 static char nmistack[4096];
 static char dfstack[4096];
+static char pfstack[4096];
+
+/*
+ * Runtime page table manipulation.  The boot page tables (pagetable.S)
+ * identity map the first 4GB using 2MB pages.  When a single page
+ * within a large page needs to be changed, e.g. to unmap a stack guard
+ * page, the large page is split into a page table of 4k pages.
+ *
+ * The second 512GB of address space is used as the demand paging
+ * window (see bmk-core/vm.h).  Page tables for it are allocated as
+ * needed and never freed.
+ *
+ * Page table pages are identity mapped like everything else, so
+ * physical addresses can be used as pointers directly.
+ */
+#define PG_VALID	0x001
+#define PG_RW		0x002
+#define PG_M		0x040
+#define PG_PS		0x080
+#define PG_FRAME	0x000ffffffffff000UL
+#define PG_LGFRAME	0x000fffffffe00000UL
+
+#define PGEX_W		0x02	/* page fault error code: write access */
+
+#define PTE_IDX(va, shift) (((va) >> (shift)) & 511)
+
+#define VMWINDOW_BASE	(1UL<<39)
+#define VMWINDOW_SIZE	(1UL<<39)
+
+static inline void
+invlpg(unsigned long va)
+{
+
+	__asm__ __volatile__("invlpg (%0)" :: "r"(va) : "memory");
+}
+
+static unsigned long *
+nextlevel(unsigned long *table, unsigned int idx, int alloc)
+{
+	unsigned long *next;
+
+	if (table[idx] & PG_VALID)
+		return (void *)(table[idx] & PG_FRAME);
+	if (!alloc || (next = bmk_pgalloc_one()) == NULL)
+		return NULL;
+	bmk_memset(next, 0, BMK_PCPU_PAGE_SIZE);
+	table[idx] = (unsigned long)next | PG_VALID | PG_RW;
+	return next;
+}
+
+static unsigned long *
+pte_lookup(unsigned long va, int alloc)
+{
+	unsigned long *pml4, *pdpt, *pd, *pt;
+	unsigned long pde, pa;
+	int i;
+
+	__asm__ __volatile__("movq %%cr3, %0" : "=r"(pml4));
+	pml4 = (void *)((unsigned long)pml4 & PG_FRAME);
+	if ((pdpt = nextlevel(pml4, PTE_IDX(va, 39), alloc)) == NULL)
+		return NULL;
+	if (pdpt[PTE_IDX(va, 30)] & PG_PS)
+		return NULL;
+	if ((pd = nextlevel(pdpt, PTE_IDX(va, 30), alloc)) == NULL)
+		return NULL;
+
+	pde = pd[PTE_IDX(va, 21)];
+	if ((pde & (PG_VALID|PG_PS)) == (PG_VALID|PG_PS)) {
+		if ((pt = bmk_pgalloc_one()) == NULL)
+			return NULL;
+		pa = pde & PG_LGFRAME;
+		for (i = 0; i < 512; i++)
+			pt[i] = (pa + i*BMK_PCPU_PAGE_SIZE) | PG_VALID | PG_RW;
+		pd[PTE_IDX(va, 21)] = (unsigned long)pt | PG_VALID | PG_RW;
+
+		/* flush the stale large page translation */
+		__asm__ __volatile__("movq %%cr3, %%rax; movq %%rax, %%cr3"
+		    ::: "rax", "memory");
+	} else if ((pt = nextlevel(pd, PTE_IDX(va, 21), alloc)) == NULL) {
+		return NULL;
+	}
+
+	return &pt[PTE_IDX(va, 12)];
+}
+
+static void
+cpu_stackguard(void *va, int on)
+{
+	unsigned long *pte;
+
+	if ((pte = pte_lookup((unsigned long)va, 0)) == NULL)
+		return;
+	if (on)
+		*pte &= ~PG_VALID;
+	else
+		*pte |= PG_VALID;
+	invlpg((unsigned long)va);
+}
+
+static int
+cpu_vm_map(unsigned long va, void *page, int writable)
+{
+	unsigned long *pte;
+
+	if ((pte = pte_lookup(va, 1)) == NULL)
+		return BMK_ENOMEM;
+	*pte = (unsigned long)page | PG_VALID | (writable ? PG_RW : 0);
+	invlpg(va);
+	return 0;
+}
+
+static void
+cpu_vm_unmap(unsigned long va)
+{
+	unsigned long *pte;
+
+	if ((pte = pte_lookup(va, 0)) == NULL || (*pte & PG_VALID) == 0)
+		return;
+	*pte = 0;
+	invlpg(va);
+}
+
+static int
+cpu_vm_dirty(unsigned long va, int clear)
+{
+	unsigned long *pte;
+
+	if ((pte = pte_lookup(va, 0)) == NULL || (*pte & PG_VALID) == 0)
+		return 0;
+	if ((*pte & PG_M) == 0)
+		return 0;
+	if (clear) {
+		*pte &= ~PG_M;
+		invlpg(va);
+	}
+	return 1;
+}
+
+static const struct bmk_vmops cpu_vmops = {
+	.vmo_map = cpu_vm_map,
+	.vmo_unmap = cpu_vm_unmap,
+	.vmo_dirty = cpu_vm_dirty,
+};
 
 /*
  * This routine fills out the interrupt descriptors so that
@@ -121,6 +269,7 @@ cpu_init(void)
 	amd64_lidt(&region);
 
 	x86_initpic();
+	x86_initfpu();
 
 	/*
 	 * fill TSS
@@ -128,6 +277,16 @@ cpu_init(void)
 	mytss.tss_ist[0] = (unsigned long)intrstack + sizeof(intrstack)-16;
 	mytss.tss_ist[1] = (unsigned long)nmistack + sizeof(nmistack)-16;
 	mytss.tss_ist[2] = (unsigned long)dfstack + sizeof(dfstack)-16;
+	mytss.tss_ist[3] = (unsigned long)pfstack + sizeof(pfstack)-16;
+
+	/*
+	 * Page faults get a stack of their own, so that running off the
+	 * end of a thread stack into its guard page can be reported
+	 * instead of escalating into a double fault.
+	 */
+	x86_fillgate(14, x86_trap_14, 4);
+	bmk_sched_set_stackguard(cpu_stackguard);
+	bmk_vm_init(&cpu_vmops, VMWINDOW_BASE, VMWINDOW_SIZE);
 
 	struct taskgate_descriptor *td = (void *)&cpu_gdt64[4];
 	td->td_lolimit = 0;
@@ -150,9 +309,70 @@ cpu_fattrap(const char *name, void *rip, unsigned long cr2)
 {
 
 	bmk_printf("FATAL TRAP: %s at %p (0x%lx)\n", name, rip, cr2);
+	bmk_printf_flush();
+	hlt();
+}
+
+struct iretframe {
+	unsigned long if_rip;
+	unsigned long if_cs;
+	unsigned long if_rflags;
+	unsigned long if_rsp;
+	unsigned long if_ss;
+};
+
+void x86_pagefault_tramp(void);
+
+/*
+ * Page fault handler, runs on the page fault IST stack with interrupts
+ * disabled.  Faults in the demand paging window are resolved in the
+ * context of the faulting thread, since doing so may block: the
+ * return frame is rewritten so that the thread "calls"
+ * x86_pagefault_tramp, which returns to the faulting instruction.
+ * The red zone below the interrupted stack pointer is skipped.
+ */
+void cpu_pagefault(unsigned long, unsigned long, struct iretframe *);
+void
+cpu_pagefault(unsigned long cr2, unsigned long err, struct iretframe *tf)
+{
+	const char *thrname;
+	unsigned long *sp;
+
+	if (bmk_vm_inwindow(cr2)) {
+		sp = (unsigned long *)(tf->if_rsp - 128);
+		*--sp = tf->if_rip;
+		*--sp = err;
+		*--sp = cr2;
+		tf->if_rsp = (unsigned long)sp;
+		tf->if_rip = (unsigned long)x86_pagefault_tramp;
+		return;
+	}
+
+	if ((thrname = bmk_sched_stackoverflow((void *)cr2)) != NULL)
+		bmk_printf("FATAL TRAP: stack overflow in thread \"%s\" "
+		    "at 0x%lx (0x%lx)\n", thrname, tf->if_rip, cr2);
+	else
+		bmk_printf("FATAL TRAP: page fault at 0x%lx (0x%lx)\n",
+		    tf->if_rip, cr2);
+	bmk_printf_flush();
 	hlt();
 }
 
+/*
+ * Called from x86_pagefault_tramp in thread context.
+ */
+void cpu_pagefault_thread(unsigned long, unsigned long);
+void
+cpu_pagefault_thread(unsigned long cr2, unsigned long err)
+{
+
+	if (bmk_vm_fault(cr2, err & PGEX_W) != 0) {
+		bmk_printf("FATAL TRAP: unresolvable page fault at 0x%lx\n",
+		    cr2);
+		bmk_platform_halt(NULL);
+	}
+}
+
 void
 bmk_platform_cpu_sched_settls(struct bmk_tcb *next)
 {
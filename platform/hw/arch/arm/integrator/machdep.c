@@ -34,6 +34,7 @@
 #include <hw/kernel.h>
 
 #include <bmk-core/core.h>
+#include <bmk-core/errno.h>
 #include <bmk-core/mainthread.h>
 #include <bmk-core/pgalloc.h>
 #include <bmk-core/platform.h>
@@ -172,6 +173,36 @@ bmk_platform_cpu_clock_epochoffset(void)
 	return 0;
 }
 
+/* the timer is too coarse to be useful as a raw counter */
+uint64_t
+bmk_platform_cpu_counter(void)
+{
+
+	return 0;
+}
+
+uint64_t
+bmk_platform_cpu_counter_freq(void)
+{
+
+	return 0;
+}
+
+/* no hardware entropy source on the board */
+unsigned long
+bmk_platform_getentropy(void *buf, unsigned long len)
+{
+
+	return 0;
+}
+
+int
+bmk_platform_snapshot(void)
+{
+
+	return BMK_ENOSYS;
+}
+
 void
 bmk_platform_cpu_block(bmk_time_t until)
 {
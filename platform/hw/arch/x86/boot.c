@@ -27,6 +27,8 @@
 #include <hw/kernel.h>
 #include <hw/multiboot.h>
 
+#include <arch/x86/var.h>
+
 #include <bmk-core/core.h>
 #include <bmk-core/mainthread.h>
 #include <bmk-core/sched.h>
@@ -40,6 +42,7 @@ x86_boot(struct multiboot_info *mbi)
 	bmk_printf("rump kernel bare metal bootstrap\n\n");
 
 	cpu_init();
+	virtiornd_init();
 	bmk_sched_init();
 	multiboot(mbi);
 
@@ -72,6 +72,12 @@ static uint64_t tsc_base;
 /* Multiplier for converting TSC ticks to nsecs. (0.32) fixed point. */
 static uint32_t tsc_mult;
 
+/* Calibrated TSC frequency. */
+static uint64_t tsc_freq;
+
+/* TSC frequency if it is safe to read directly, else 0. */
+static uint64_t counter_freq;
+
 /*
  * pvclock specific.
  */
@@ -87,6 +93,7 @@ struct pvclock_vcpu_time_info {
 	uint8_t flags;
 	uint8_t pad[2];
 } __attribute__((__packed__));
+#define PVCLOCK_TSC_STABLE_BIT	0x01
 
 /* Xen/KVM wall clock ABI. */
 struct pvclock_wall_clock {
@@ -102,6 +109,7 @@ struct pvclock_wall_clock {
  */
 volatile static struct pvclock_vcpu_time_info pvclock_ti;
 volatile static struct pvclock_wall_clock pvclock_wc;
+static uint32_t msr_kvm_wall_clock;
 
 /*
  * Calculate prod = (a * b) where a is (64.0) fixed point and b is (0.32) fixed
@@ -247,12 +255,64 @@ tscclock_monotonic(void)
 }
 
 /*
- * Calibrate TSC and initialise TSC clock.
+ * Get the TSC frequency from CPUID, if the hypervisor or the CPU tells
+ * it, which saves calibrating it.  Returns 0 if it is not available.
+ */
+static uint64_t
+tscclock_cpuid_freq(const char **src)
+{
+	uint32_t eax, ebx, ecx, edx, maxleaf;
+	int hv;
+
+	/*
+	 * Timing leaf of VMware, also offered by KVM: TSC kHz in eax.
+	 * Other hypervisors may put something else there, so trust it
+	 * only if the signature says VMware or KVM, as Linux does.
+	 */
+	hv = hypervisor_detect();
+	if (hv == HYPERVISOR_VMWARE || hv == HYPERVISOR_KVM) {
+		x86_cpuid(0x40000000, &maxleaf, &ebx, &ecx, &edx);
+		if (maxleaf >= 0x40000010) {
+			x86_cpuid(0x40000010, &eax, &ebx, &ecx, &edx);
+			if (eax != 0) {
+				*src = "CPUID 0x40000010";
+				return (uint64_t)eax * 1000;
+			}
+		}
+	}
+
+	/*
+	 * Leaf 0x15 gives the TSC/crystal ratio in ebx/eax and the crystal
+	 * frequency in ecx.  If the crystal frequency is not enumerated,
+	 * the TSC runs at the processor base frequency from leaf 0x16.
+	 */
+	x86_cpuid(0x0, &maxleaf, &ebx, &ecx, &edx);
+	if (maxleaf < 0x15)
+		return 0;
+	x86_cpuid(0x15, &eax, &ebx, &ecx, &edx);
+	if (eax == 0 || ebx == 0)
+		return 0;
+	if (ecx != 0) {
+		*src = "CPUID 0x15";
+		return (uint64_t)ecx * ebx / eax;
+	}
+
+	if (maxleaf < 0x16)
+		return 0;
+	x86_cpuid(0x16, &eax, &ebx, &ecx, &edx);
+	if ((eax & 0xffff) == 0)
+		return 0;
+	*src = "CPUID 0x16";
+	return (uint64_t)(eax & 0xffff) * 1000 * 1000;
+}
+
+/*
+ * Determine TSC frequency and initialise TSC clock.
  */
 static int
 tscclock_init(void)
 {
-	uint64_t tsc_freq;
+	const char *src;
 
 	/* Initialise i8254 timer channel 0 to mode 2 at 100 Hz */
 	outb(TIMER_MODE, TIMER_SEL0 | TIMER_RATEGEN | TIMER_16BIT);
@@ -265,18 +325,22 @@ tscclock_init(void)
 	 * offset.
 	 */
 	rtc_epochoffset = rtc_gettimeofday();
+	tsc_base = rdtsc();
 
 	/*
-	 * Calculate TSC frequency by calibrating against an 0.1s delay
-	 * using the i8254 timer.
+	 * If CPUID does not tell, calculate TSC frequency by calibrating
+	 * against an 0.1s delay using the i8254 timer.
 	 */
-	spl0();
-	tsc_base = rdtsc();
-	i8254_delay(100000);
-	tsc_freq = (rdtsc() - tsc_base) * 10;
-	splhigh();
-	bmk_printf("x86_initclocks(): TSC frequency estimate is %llu Hz\n",
-		(unsigned long long)tsc_freq);
+	if ((tsc_freq = tscclock_cpuid_freq(&src)) == 0) {
+		spl0();
+		i8254_delay(100000);
+		tsc_freq = (rdtsc() - tsc_base) * 10;
+		splhigh();
+		src = "i8254 calibration";
+	}
+	bmk_printf("x86_initclocks(): TSC frequency is %llu Hz "
+	    "from %s, took %llu us\n", (unsigned long long)tsc_freq, src,
+	    (unsigned long long)((rdtsc() - tsc_base) * 1000000 / tsc_freq));
 
 	/*
 	 * Calculate TSC scaling multiplier.
@@ -344,11 +408,26 @@ pvclock_read_wall_clock(void)
  *
  * Source: Linux kernel, Documentation/virtual/kvm/{msr,cpuid}.txt
  */
+static void
+pvclock_register_wall_clock(void)
+{
+
+	__asm__ __volatile("wrmsr" ::
+		"c" (msr_kvm_wall_clock),
+		"a" ((uint32_t)((uintptr_t)&pvclock_wc)),
+#if defined(__x86_64__)
+		"d" ((uint32_t)((uintptr_t)&pvclock_wc >> 32))
+#else
+		"d" (0)
+#endif
+	);
+}
+
 static int
 pvclock_init(void)
 {
 	uint32_t eax, ebx, ecx, edx;
-	uint32_t msr_kvm_system_time, msr_kvm_wall_clock;
+	uint32_t msr_kvm_system_time;
 
 	if (hypervisor_detect() != HYPERVISOR_KVM)
 		return 1;
@@ -377,21 +456,31 @@ pvclock_init(void)
 		"d" (0)
 #endif
 	);
-	__asm__ __volatile("wrmsr" ::
-		"c" (msr_kvm_wall_clock),
-		"a" ((uint32_t)((uintptr_t)&pvclock_wc)),
-#if defined(__x86_64__)
-		"d" ((uint32_t)((uintptr_t)&pvclock_wc >> 32))
-#else
-		"d" (0)
-#endif
-	);
+	pvclock_register_wall_clock();
 	/* Initialise epoch offset using wall clock time */
 	rtc_epochoffset = pvclock_read_wall_clock();
 
 	return 0;
 }
 
+/*
+ * TSC frequency as seen by the hypervisor.  ns = ((tsc << shift) * mul)
+ * >> 32, so freq = (NSEC_PER_SEC << 32) / mul >> shift.
+ */
+static uint64_t
+pvclock_tsc_freq(void)
+{
+	uint64_t freq;
+
+	freq = (NSEC_PER_SEC << 32) / pvclock_ti.tsc_to_system_mul;
+	if (pvclock_ti.tsc_shift < 0)
+		freq <<= -pvclock_ti.tsc_shift;
+	else
+		freq >>= pvclock_ti.tsc_shift;
+
+	return freq;
+}
+
 void
 x86_initclocks(void)
 {
@@ -426,6 +515,18 @@ x86_initclocks(void)
 	bmk_printf("x86_initclocks(): Using %s for timekeeping\n",
 		have_pvclock ? "PV clock" : "TSC");
 
+	/*
+	 * The raw TSC can be used as a counter only if it ticks at a
+	 * constant rate.  With PV clock, the hypervisor must also
+	 * promise not to adjust it behind our back.
+	 */
+	if (invariant_tsc) {
+		if (!have_pvclock)
+			counter_freq = tsc_freq;
+		else if (pvclock_ti.flags & PVCLOCK_TSC_STABLE_BIT)
+			counter_freq = pvclock_tsc_freq();
+	}
+
 	/*
 	 * Initialise i8254 timer channel 0 to mode 4 (one shot).
 	 */
@@ -451,6 +552,40 @@ bmk_platform_cpu_clock_monotonic(void)
 		return tscclock_monotonic();
 }
 
+/*
+ * Called after the image has been resumed from a snapshot.  The
+ * hypervisor carries the TSC and PV clock over, so monotonic time
+ * continues from where it was, but wall time has moved on.  Re-read it
+ * to recompute the epoch offset.  The TSC frequency is assumed to be
+ * the same as before, which saves recalibrating it.
+ */
+void
+x86_resumeclocks(void)
+{
+
+	if (have_pvclock) {
+		/* writing the MSR makes the hypervisor update the struct */
+		pvclock_register_wall_clock();
+		rtc_epochoffset = pvclock_read_wall_clock();
+	} else {
+		rtc_epochoffset = rtc_gettimeofday() - tscclock_monotonic();
+	}
+}
+
+uint64_t
+bmk_platform_cpu_counter(void)
+{
+
+	return rdtsc();
+}
+
+uint64_t
+bmk_platform_cpu_counter_freq(void)
+{
+
+	return counter_freq;
+}
+
 /*
  * Return epoch offset (wall time offset to monotonic clock start).
  */
@@ -32,6 +32,7 @@
 #include <bmk-core/printf.h>
 
 static void (*vcons_putc)(int) = vgacons_putc;
+static void (*vcons_write)(const char *, unsigned long);
 
 /*
  * Filled in by locore from BIOS data area.
@@ -59,12 +60,22 @@ cons_init(void)
 	if (bios_crtc_base == 0)
 		prefer_serial = 1;
 
-	if (prefer_serial && bios_com1_base != 0) {
+	/*
+	 * A virtio console is present only if explicitly configured,
+	 * so prefer it over everything else.  Unlike the serial port,
+	 * it takes a batch of output with one VM exit.
+	 */
+	if (virtiocons_init()) {
+		vcons_putc = virtiocons_putc;
+		vcons_write = virtiocons_write;
+	} else if (prefer_serial && bios_com1_base != 0) {
 		cons_puts("Using serial console.");
 		serialcons_init(bios_com1_base, 115200);
 		vcons_putc = serialcons_putc;
+		vcons_write = serialcons_write;
 	}
 	bmk_printf_init(vcons_putc, NULL);
+	bmk_printf_setwrite(vcons_write);
 }
 
 void
@@ -56,7 +56,36 @@ serialcons_putc(int c)
 	/*
 	 * Write a single character at a time, while the output FIFO has space.
 	 */
-	while ((inb(combase + COM_LSR) & 0x20) == 0)
+	while ((inb(combase + COM_LSR) & COM_LSR_TXRDY) == 0)
 		;
 	outb(combase + COM_DATA, c);
 }
+
+/*
+ * Write a batch of characters.  The transmitter empty bit means that
+ * the whole FIFO is free, so poll the status register once per
+ * COM_FIFOLEN characters instead of once per character.
+ */
+void
+serialcons_write(const char *buf, unsigned long len)
+{
+	unsigned long i;
+	int n, cr = 0;
+
+	if (!combase)
+		return;
+
+	for (i = 0; i < len; ) {
+		while ((inb(combase + COM_LSR) & COM_LSR_TXRDY) == 0)
+			;
+		for (n = 0; n < COM_FIFOLEN && i < len; n++) {
+			if (buf[i] == '\n' && !cr) {
+				outb(combase + COM_DATA, '\r');
+				cr = 1;
+				continue;
+			}
+			outb(combase + COM_DATA, buf[i++]);
+			cr = 0;
+		}
+	}
+}
@@ -0,0 +1,81 @@
+/*-
+ * Copyright (c) 2026 The rumprun contributors.  All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Snapshot support for use with a hypervisor which can save and
+ * restore the guest's memory and device state, e.g. QEMU's "migrate"
+ * to a file and "-incoming" from it.  Everything, including the page
+ * allocator and the rump kernel, lives in guest memory, so all we
+ * need to do is to stay put while the state is being saved, and to
+ * fix up what the outside world changed when we get going again.
+ *
+ * We announce on the console that we are ready, and then spin with
+ * interrupts disabled, so that no device is being driven while it
+ * is saved.  Writing a byte to the first serial port resumes, either
+ * in the original instance or in a copy restored from the snapshot.
+ */
+
+#include <hw/types.h>
+#include <hw/kernel.h>
+
+#include <arch/x86/var.h>
+
+#include <bmk-core/errno.h>
+#include <bmk-core/platform.h>
+#include <bmk-core/printf.h>
+
+static int
+com1_drain(void)
+{
+	int n;
+
+	for (n = 0; inb(bios_com1_base + COM_LSR) & COM_LSR_RXRDY; n++)
+		(void)inb(bios_com1_base + COM_DATA);
+	return n;
+}
+
+int
+bmk_platform_snapshot(void)
+{
+
+	if (bios_com1_base == 0)
+		return BMK_ENXIO;
+
+	splhigh();
+	com1_drain();
+
+	bmk_printf("=== ready for snapshot, write to COM1 to resume ===\n");
+	bmk_printf_flush();
+
+	while (com1_drain() == 0)
+		__asm__ __volatile__("pause");
+
+	x86_resumeclocks();
+	spl0();
+
+	bmk_printf("=== resumed ===\n");
+
+	return 0;
+}
@@ -0,0 +1,73 @@
+/*-
+ * Copyright (c) 2026 The rumprun contributors.  All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <hw/types.h>
+#include <hw/kernel.h>
+
+#include <arch/x86/virtio.h>
+
+#define PCI_CONF_ADDR		0xcf8
+#define PCI_CONF_DATA		0xcfc
+
+static uint32_t
+pciconf_read(unsigned dev, int reg)
+{
+
+	outl(PCI_CONF_ADDR, (1U<<31) | (dev<<11) | (reg & 0xfc));
+	return inl(PCI_CONF_DATA);
+}
+
+static void
+pciconf_write(unsigned dev, int reg, uint32_t value)
+{
+
+	outl(PCI_CONF_ADDR, (1U<<31) | (dev<<11) | (reg & 0xfc));
+	outl(PCI_CONF_DATA, value);
+}
+
+int
+virtio_pci_find(uint16_t devid, uint16_t *iobase)
+{
+	uint32_t id, bar;
+	unsigned dev;
+
+	/* the devices are always on bus 0 on the machines we care about */
+	for (dev = 0; dev < 32; dev++) {
+		id = pciconf_read(dev, PCI_CONF_ID);
+		if ((id & 0xffff) == VIRTIO_VENDOR && (id >> 16) == devid)
+			break;
+	}
+	if (dev == 32)
+		return 0;
+
+	bar = pciconf_read(dev, PCI_CONF_BAR0);
+	if ((bar & 1) == 0)
+		return 0;
+	pciconf_write(dev, PCI_CONF_CMD,
+	    pciconf_read(dev, PCI_CONF_CMD) | PCI_CMD_IO | PCI_CMD_MASTER);
+	*iobase = bar & ~3;
+
+	return 1;
+}
@@ -0,0 +1,146 @@
+/*-
+ * Copyright (c) 2026 The rumprun contributors.  All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Minimal output-only driver for a legacy virtio-pci console (QEMU
+ * "-device virtio-serial -device virtconsole" and friends).  Only the
+ * transmit queue of port 0 is used, and it is polled, so that the
+ * console works before interrupts and the scheduler are available.
+ * A batch of output costs one queue notify, i.e. one VM exit, instead
+ * of one exit per character as with the emulated serial port.
+ *
+ * The rump kernel PCI driver set has no virtio console driver, so
+ * nothing else will try to claim the device.
+ */
+
+#include <hw/types.h>
+#include <hw/kernel.h>
+
+#include <arch/x86/cons.h>
+#include <arch/x86/virtio.h>
+
+#include <bmk-core/string.h>
+
+/* port 0 transmit queue, with the MULTIPORT feature not negotiated */
+#define VIRTIOCONS_TXQ		1
+
+/* memory is identity mapped, so the virtual address is also physical */
+static uint8_t vring_mem[VRING_MEMSIZE]
+    __attribute__((aligned(VRING_ALIGN)));
+static char txbuf[VRING_ALIGN];
+
+static uint16_t viobase;
+static unsigned qsize;
+static struct vring_desc *desc;
+static struct vring_avail *avail;
+static volatile struct vring_used *used;
+static uint16_t avail_idx;
+
+int
+virtiocons_init(void)
+{
+
+	if (virtio_pci_find(VIRTIO_DEV_CONSOLE, &viobase) == 0)
+		return 0;
+
+	outb(viobase + VIRTIO_STATUS, 0);
+	outb(viobase + VIRTIO_STATUS, VIRTIO_STATUS_ACK);
+	outb(viobase + VIRTIO_STATUS, VIRTIO_STATUS_ACK|VIRTIO_STATUS_DRIVER);
+	outl(viobase + VIRTIO_GUEST_FEATURES, 0);
+
+	outw(viobase + VIRTIO_QUEUE_SELECT, VIRTIOCONS_TXQ);
+	qsize = inw(viobase + VIRTIO_QUEUE_SIZE);
+	if (qsize == 0 || qsize > VRING_MAXSIZE) {
+		outb(viobase + VIRTIO_STATUS, 0);
+		viobase = 0;
+		return 0;
+	}
+
+	bmk_memset(vring_mem, 0, sizeof(vring_mem));
+	desc = (void *)vring_mem;
+	avail = (void *)(vring_mem + VRING_AVAILOFF(qsize));
+	used = (void *)(vring_mem + VRING_USEDOFF(qsize));
+	avail->flags = VRING_AVAIL_F_NO_INTERRUPT;
+
+	/* a single descriptor pointing to txbuf is reused for every write */
+	desc[0].addr = (unsigned long)txbuf;
+
+	outl(viobase + VIRTIO_QUEUE_PFN, (unsigned long)vring_mem / VRING_ALIGN);
+	outb(viobase + VIRTIO_STATUS,
+	    VIRTIO_STATUS_ACK|VIRTIO_STATUS_DRIVER|VIRTIO_STATUS_DRIVER_OK);
+
+	return 1;
+}
+
+/*
+ * Wait until the host has consumed the previous buffer.
+ */
+static void
+virtiocons_wait(void)
+{
+
+	while (used->idx != avail_idx)
+		__asm__ __volatile__("pause" ::: "memory");
+}
+
+static void
+virtiocons_send(unsigned len)
+{
+
+	desc[0].len = len;
+	avail->ring[avail_idx % qsize] = 0;
+	__asm__ __volatile__("" ::: "memory");
+	avail->idx = ++avail_idx;
+	__asm__ __volatile__("" ::: "memory");
+	outw(viobase + VIRTIO_QUEUE_NOTIFY, VIRTIOCONS_TXQ);
+}
+
+void
+virtiocons_write(const char *buf, unsigned long len)
+{
+	unsigned long i;
+	unsigned n;
+
+	if (!viobase)
+		return;
+
+	for (i = 0; i < len; ) {
+		virtiocons_wait();
+		for (n = 0; n < sizeof(txbuf)-1 && i < len; i++) {
+			if (buf[i] == '\n')
+				txbuf[n++] = '\r';
+			txbuf[n++] = buf[i];
+		}
+		virtiocons_send(n);
+	}
+}
+
+void
+virtiocons_putc(int c)
+{
+	char ch = c;
+
+	virtiocons_write(&ch, 1);
+}
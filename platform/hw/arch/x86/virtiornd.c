@@ -0,0 +1,124 @@
+/*-
+ * Copyright (c) 2026 The rumprun contributors.  All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Hardware entropy for bmk_platform_getentropy().  If a virtio-rng
+ * device is present, a seed is read from it at boot with a polled
+ * legacy virtio-pci request, after which the device is reset so that
+ * the rump kernel's viornd driver can attach to it normally.  After
+ * the seed is used up, or if the device does not answer within
+ * VIRTIORND_WAIT, entropy comes from the cpu (RDSEED/RDRAND).  Must be
+ * called after the clocks have been initialised.
+ */
+
+#include <hw/types.h>
+#include <hw/kernel.h>
+
+#include <arch/x86/var.h>
+#include <arch/x86/virtio.h>
+
+#include <bmk-core/platform.h>
+#include <bmk-core/string.h>
+
+#define VIRTIORND_SEEDSIZE	64
+#define VIRTIORND_WAIT		(10*1000*1000ULL)	/* 10ms */
+
+static uint8_t vring_mem[VRING_MEMSIZE]
+    __attribute__((aligned(VRING_ALIGN)));
+static uint8_t seed[VIRTIORND_SEEDSIZE];
+static unsigned seedlen, seedoff;
+
+void
+virtiornd_init(void)
+{
+	struct vring_desc *desc;
+	struct vring_avail *avail;
+	volatile struct vring_used *used;
+	bmk_time_t deadline;
+	uint16_t viobase;
+	unsigned qsize;
+
+	if (!virtio_pci_find(VIRTIO_DEV_RNG, &viobase))
+		return;
+
+	outb(viobase + VIRTIO_STATUS, 0);
+	outb(viobase + VIRTIO_STATUS, VIRTIO_STATUS_ACK);
+	outb(viobase + VIRTIO_STATUS, VIRTIO_STATUS_ACK|VIRTIO_STATUS_DRIVER);
+	outl(viobase + VIRTIO_GUEST_FEATURES, 0);
+
+	outw(viobase + VIRTIO_QUEUE_SELECT, 0);
+	qsize = inw(viobase + VIRTIO_QUEUE_SIZE);
+	if (qsize == 0 || qsize > VRING_MAXSIZE)
+		goto out;
+
+	bmk_memset(vring_mem, 0, sizeof(vring_mem));
+	desc = (void *)vring_mem;
+	avail = (void *)(vring_mem + VRING_AVAILOFF(qsize));
+	used = (void *)(vring_mem + VRING_USEDOFF(qsize));
+	avail->flags = VRING_AVAIL_F_NO_INTERRUPT;
+
+	desc[0].addr = (unsigned long)seed;
+	desc[0].len = sizeof(seed);
+	desc[0].flags = VRING_DESC_F_WRITE;
+	avail->ring[0] = 0;
+	avail->idx = 1;
+
+	outl(viobase + VIRTIO_QUEUE_PFN, (unsigned long)vring_mem / VRING_ALIGN);
+	outb(viobase + VIRTIO_STATUS,
+	    VIRTIO_STATUS_ACK|VIRTIO_STATUS_DRIVER|VIRTIO_STATUS_DRIVER_OK);
+	outw(viobase + VIRTIO_QUEUE_NOTIFY, 0);
+
+	/* the host may rate limit the device, so don't hold up boot */
+	deadline = bmk_platform_cpu_clock_monotonic() + VIRTIORND_WAIT;
+	while (used->idx == 0
+	    && bmk_platform_cpu_clock_monotonic() < deadline)
+		__asm__ __volatile__("pause" ::: "memory");
+	if (used->idx != 0) {
+		seedlen = used->ring[0].len;
+		if (seedlen > sizeof(seed))
+			seedlen = sizeof(seed);
+	}
+
+ out:
+	/* leave the device for the rump kernel */
+	outb(viobase + VIRTIO_STATUS, 0);
+}
+
+unsigned long
+bmk_platform_getentropy(void *buf, unsigned long len)
+{
+	unsigned long n = 0;
+
+	if (seedoff < seedlen) {
+		n = seedlen - seedoff;
+		if (n > len)
+			n = len;
+		bmk_memcpy(buf, seed + seedoff, n);
+		bmk_memset(seed + seedoff, 0, n);
+		seedoff += n;
+	}
+
+	return n + bmk_cpu_getentropy((uint8_t *)buf + n, len - n);
+}
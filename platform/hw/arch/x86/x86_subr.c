@@ -26,6 +26,8 @@
 #include <hw/kernel.h>
 #include <arch/x86/var.h>
 
+#include <bmk-core/sched.h>
+
 void
 x86_initpic(void)
 {
@@ -81,6 +83,56 @@ x86_initidt(void)
 	x86_fillgate(8, x86_trap_8, 3);
 }
 
+/*
+ * Bytes needed to save the FPU state in x86_pagefault_tramp: the
+ * fxsave area, or the xsave area for the components enabled in XCR0.
+ */
+uint32_t x86_fpu_savesize = 512;
+
+/*
+ * SSE was enabled in locore.  If the CPU has AVX, also enable XSAVE
+ * and the AVX (and AVX-512) register state so that code may use them.
+ * No per-thread save area is required, see bmk_cpu_sched_switch().
+ */
+void
+x86_initfpu(void)
+{
+	uint32_t eax, ebx, ecx, edx;
+	unsigned long cr4;
+	uint32_t xcr0;
+
+	x86_cpuid(0x0, &eax, &ebx, &ecx, &edx);
+	if (eax < 0xd)
+		return;
+	x86_cpuid(0x1, &eax, &ebx, &ecx, &edx);
+	if ((ecx & (CPUID2_XSAVE|CPUID2_AVX)) != (CPUID2_XSAVE|CPUID2_AVX))
+		return;
+
+	__asm__ __volatile__("mov %%cr4, %0" : "=r"(cr4));
+	cr4 |= CR4_OSXSAVE;
+	__asm__ __volatile__("mov %0, %%cr4" :: "r"(cr4));
+
+	/* state components supported by XSAVE, leaf 0xd subleaf 0 */
+	__asm__("cpuid"
+		: "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx)
+		: "0" (0xd), "2" (0));
+	if ((eax & (XCR0_SSE|XCR0_AVX)) != (XCR0_SSE|XCR0_AVX))
+		return;
+
+	xcr0 = XCR0_X87|XCR0_SSE|XCR0_AVX;
+	if ((eax & XCR0_AVX512) == XCR0_AVX512)
+		xcr0 |= XCR0_AVX512;
+	__asm__ __volatile__("xsetbv" :: "c"(0), "a"(xcr0), "d"(0));
+
+	/* ebx of leaf 0xd subleaf 0 is the size for the current XCR0 */
+	__asm__("cpuid"
+		: "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx)
+		: "0" (0xd), "2" (0));
+	x86_fpu_savesize = ebx;
+
+	bmk_cpu_x86_avx = 1;
+}
+
 void
 x86_cpuid(uint32_t level, uint32_t *eax_out, uint32_t *ebx_out,
 		uint32_t *ecx_out, uint32_t *edx_out)
@@ -1,4 +1,8 @@
 void serialcons_init(uint16_t, int);
 void serialcons_putc(int);
+void serialcons_write(const char *, unsigned long);
+int virtiocons_init(void);
+void virtiocons_putc(int);
+void virtiocons_write(const char *, unsigned long);
 void vgacons_putc(int);
 
@@ -25,6 +25,23 @@ outb(uint16_t port, uint8_t value)
         __asm__ __volatile__("outb %0, %1" :: "a"(value), "d"(port));
 }
 
+static inline uint16_t
+inw(uint16_t port)
+{
+        uint16_t rv;
+
+        __asm__ __volatile__("inw %1, %0" : "=a"(rv) : "d"(port));
+
+        return rv;
+}
+
+static inline void
+outw(uint16_t port, uint16_t value)
+{
+
+        __asm__ __volatile__("outw %0, %1" :: "a"(value), "d"(port));
+}
+
 static inline void
 outl(uint16_t port, uint32_t value)
 {
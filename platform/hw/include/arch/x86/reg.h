@@ -9,6 +9,15 @@
 #define CR4_OSXMMEXCPT	0x00000400 /* OS support for unmasked SIMD FP exceptions */
 #define CR4_OSFXSR	0x00000200 /* OS support for FXSAVE & FXRSTOR */
 #define CR4_PAE		0x00000020 /* Physical Address Extension */
+#define CR4_OSXSAVE	0x00040000 /* OS support for XSAVE & XSETBV */
+
+#define CPUID2_XSAVE	0x04000000
+#define CPUID2_AVX	0x10000000
+
+#define XCR0_X87	0x00000001
+#define XCR0_SSE	0x00000002
+#define XCR0_AVX	0x00000004
+#define XCR0_AVX512	0x000000e0 /* opmask, ZMM_Hi256, Hi16_ZMM */
 
 /* Extended Feature Enable Register */
 #define MSR_EFER	0xc0000080
@@ -57,5 +66,9 @@
 #define COM_LCTL	3
 #define COM_LSR		5
 
+#define COM_LSR_RXRDY	0x01
+#define COM_LSR_TXRDY	0x20
+#define COM_FIFOLEN	16
+
 #define BIOS_COM1_BASE	0x400
 #define BIOS_CRTC_BASE	0x463
@@ -5,8 +5,14 @@ void	x86_boot(struct multiboot_info *);
 void	x86_initpic(void);
 void	x86_initidt(void);
 void	x86_initclocks(void);
+void	x86_resumeclocks(void);
+void	x86_initfpu(void);
 void	x86_fillgate(int, void *, int);
 
+void	virtiornd_init(void);
+
+extern uint16_t bios_com1_base;
+
 /* trap "handlers" */
 void x86_trap_0(void);
 void x86_trap_2(void);
@@ -26,4 +32,5 @@ void x86_trap_17(void);
 void x86_cpuid(uint32_t, uint32_t *, uint32_t *, uint32_t *, uint32_t *);
 
 extern uint8_t pic1mask, pic2mask;
+extern uint32_t x86_fpu_savesize;
 #endif
@@ -0,0 +1,68 @@
+/*
+ * Bits for the minimal polled legacy virtio-pci drivers used before
+ * the rump kernel is up, see virtiocons.c and virtiornd.c.
+ */
+
+#define PCI_CONF_ID		0x00
+#define PCI_CONF_CMD		0x04
+#define PCI_CONF_BAR0		0x10
+#define PCI_CMD_IO		0x01
+#define PCI_CMD_MASTER		0x04
+
+#define VIRTIO_VENDOR		0x1af4
+#define VIRTIO_DEV_CONSOLE	0x1003
+#define VIRTIO_DEV_RNG		0x1005
+
+/* legacy virtio-pci i/o register layout */
+#define VIRTIO_GUEST_FEATURES	0x04
+#define VIRTIO_QUEUE_PFN	0x08
+#define VIRTIO_QUEUE_SIZE	0x0c
+#define VIRTIO_QUEUE_SELECT	0x0e
+#define VIRTIO_QUEUE_NOTIFY	0x10
+#define VIRTIO_STATUS		0x12
+#define VIRTIO_STATUS_ACK	0x01
+#define VIRTIO_STATUS_DRIVER	0x02
+#define VIRTIO_STATUS_DRIVER_OK	0x04
+
+#define VRING_ALIGN		4096
+#define VRING_MAXSIZE		256
+
+struct vring_desc {
+	uint64_t addr;
+	uint32_t len;
+	uint16_t flags;
+	uint16_t next;
+};
+#define VRING_DESC_F_WRITE	2
+
+struct vring_avail {
+	uint16_t flags;
+	uint16_t idx;
+	uint16_t ring[];
+};
+#define VRING_AVAIL_F_NO_INTERRUPT 1
+
+struct vring_used_elem {
+	uint32_t id;
+	uint32_t len;
+};
+
+struct vring_used {
+	uint16_t flags;
+	uint16_t idx;
+	struct vring_used_elem ring[];
+};
+
+/* enough for a ring of VRING_MAXSIZE entries */
+#define VRING_MEMSIZE		(3*VRING_ALIGN)
+
+#define VRING_ALIGNUP(x) (((x) + VRING_ALIGN-1) & ~(VRING_ALIGN-1))
+#define VRING_AVAILOFF(qsize) ((qsize) * sizeof(struct vring_desc))
+#define VRING_USEDOFF(qsize) VRING_ALIGNUP(VRING_AVAILOFF(qsize)	\
+    + sizeof(struct vring_avail) + ((qsize)+1) * sizeof(uint16_t))
+
+/*
+ * Find a legacy virtio-pci device with the given device id on bus 0
+ * and enable its i/o space.  Returns 1 and sets the i/o base if found.
+ */
+int virtio_pci_find(uint16_t, uint16_t *);
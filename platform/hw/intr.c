@@ -169,9 +169,13 @@ void
 isr(int which)
 {
 
+	bmk_sched_trace_intr(which, 0);
+
 	/* schedule the interrupt handler */
 	isr_todo |= which;
 	bmk_sched_wake(isr_thread);
+
+	bmk_sched_trace_intr(which, 1);
 }
 
 void
@@ -186,4 +190,5 @@ intr_init(void)
 	isr_thread = bmk_sched_create("isrthr", NULL, 0, doisr, NULL, NULL, 0);
 	if (!isr_thread)
 		bmk_platform_halt("intr_init");
+	bmk_sched_setpri(isr_thread, BMK_SCHED_PRI_INTR);
 }
@@ -55,6 +55,7 @@ bmk_platform_halt(const char *panicstring)
 	if (panicstring)
 		bmk_printf("PANIC: %s\n", panicstring);
 	bmk_printf("halted\n");
+	bmk_printf_flush();
 	for (;;)
 		hlt();
 }
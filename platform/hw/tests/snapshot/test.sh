@@ -0,0 +1,81 @@
+#!/bin/sh
+#
+# Test snapshot/restore using QEMU's migration to a file.
+#
+# A rumprun image with RUMPRUN_SNAPSHOT set in its environment stops
+# at the end of boot, before main() is called, and waits until a byte
+# is written to COM1.  We boot test-app to that point, save it to a
+# file and throw the original away.  Then we restore a copy from the
+# file, resume it, and check that main() runs.  The console is put on
+# virtio so that COM1 is free for the resume signal.
+#
+# The config must be given in the same JSON form that "rumprun" uses.
+
+if ! type qemu-system-x86_64 >/dev/null 2>&1; then
+	echo ERROR: qemu-system-x86_64 required but not found
+	exit 1
+fi
+if ! type socat >/dev/null 2>&1; then
+	echo ERROR: socat required but not found
+	exit 1
+fi
+
+CFG=${1:-'{"cmdline": "test-app", "env": "RUMPRUN_SNAPSHOT=1"}'}
+
+qemu ()
+{
+
+	rm -f console.log com1.sock mon.sock
+	qemu-system-x86_64 -m 128 -net none -display none -no-reboot	\
+	    -device virtio-serial -device virtconsole,chardev=cons	\
+	    -chardev file,id=cons,path=console.log			\
+	    -chardev socket,id=com1,path=com1.sock,server=on,wait=off	\
+	    -serial chardev:com1					\
+	    -monitor unix:mon.sock,server=on,wait=off			\
+	    -kernel test-app -append "${CFG}" "$@" &
+}
+
+monitor ()
+{
+
+	echo "$@" | socat - unix-connect:mon.sock >/dev/null
+}
+
+# waitfor string: poll the console for up to 10s
+waitfor ()
+{
+
+	for x in $(seq 100); do
+		grep -q "$1" console.log 2>/dev/null && return 0
+		sleep 0.1
+	done
+	echo ERROR: timed out waiting for \"$1\"
+	cat console.log
+	return 1
+}
+
+rv=1
+rm -f snapshot.img
+
+qemu
+if waitfor 'ready for snapshot'; then
+	monitor stop
+	monitor 'migrate "exec:cat > snapshot.img"'
+	sleep 1
+	monitor quit
+	wait
+
+	qemu -incoming 'exec:cat snapshot.img'
+	sleep 1
+	monitor cont
+	echo | socat - unix-connect:com1.sock
+	if waitfor 'main() of'; then
+		echo snapshot ok
+		rv=0
+	fi
+	monitor quit
+	wait
+fi
+
+rm -f console.log com1.sock mon.sock snapshot.img
+exit ${rv}
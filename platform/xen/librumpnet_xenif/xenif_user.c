@@ -31,9 +31,11 @@ struct iovec {
 
 #include <mini-os/os.h>
 #include <mini-os/netfront.h>
+#include <mini-os/xenbus.h>
 
 #include <bmk-core/errno.h>
 #include <bmk-core/memalloc.h>
+#include <bmk-core/printf.h>
 #include <bmk-core/string.h>
 #include <bmk-core/sched.h>
 
@@ -44,56 +46,54 @@ struct iovec {
 #include "if_virt_user.h"
 
 /*
- * For now, shovel the packets from the interrupt to a
- * thread context via an intermediate set of buffers.  Need
- * to fix this a bit down the road.
+ * Received packets are collected by the pusher thread, not in the
+ * event handler, so that a batch of them can be delivered to the
+ * rump kernel with one schedule.  While there is a backlog, the
+ * pusher keeps polling the ring with the event left unarmed, at most
+ * viu_budget packets at a time.  It goes back to waiting for an event
+ * only after the ring has been drained.
+ *
+ * The budget can be set per interface in xenstore with
+ * device/vif/N/rumprun-rx-budget.
  */
-#define MAXPKT 2000
-struct onepkt {
-	unsigned char pkt_data[MAXPKT];
-	int pkt_dlen;
-};
+#define RXBUDGET_DEFAULT 64
 
-#define NBUF 64
 struct virtif_user {
 	struct netfront_dev *viu_dev;
 	struct bmk_thread *viu_rcvr;
 	struct bmk_thread *viu_thr;
 	struct virtif_sc *viu_vifsc;
 
-	int viu_read;
-	int viu_write;
+	int viu_budget;
+	int viu_rxpending;
 	int viu_dying;
-	struct onepkt viu_pkts[NBUF];
 };
 
 /*
- * Ok, based on how (the unmodified) netfront works, we need to
- * consume the data here.  So store it locally (and revisit some day).
+ * Called by netfront_rxpoll() for each packet, with the rump kernel
+ * scheduled.  The data is copied into an mbuf, so the ring buffer can
+ * be handed back to the backend once we return.
  */
 static void
 myrecv(struct netfront_dev *dev, unsigned char *data, int dlen)
 {
 	struct virtif_user *viu = netfront_get_private(dev);
-	int nextw;
-
-	/* TODO: we should be at the correct spl already, assert how? */
-
-	nextw = (viu->viu_write+1) % NBUF;
-	/* queue full?  drop packet */
-	if (nextw == viu->viu_read) {
-		return;
-	}
+	struct iovec iov;
 
-	if (dlen > MAXPKT) {
-		minios_printk("myrecv: pkt len %d too big\n", dlen);
-		return;
-	}
+	iov.iov_base = data;
+	iov.iov_len = dlen;
+	rump_virtif_pktdeliver(viu->viu_vifsc, &iov, 1);
+}
 
-	bmk_memcpy(viu->viu_pkts[viu->viu_write].pkt_data, data, dlen);
-	viu->viu_pkts[viu->viu_write].pkt_dlen = dlen;
-	viu->viu_write = nextw;
+/*
+ * Called from the event handler when the ring has packets.
+ */
+static void
+myrecvnotify(struct netfront_dev *dev)
+{
+	struct virtif_user *viu = netfront_get_private(dev);
 
+	viu->viu_rxpending = 1;
 	if (viu->viu_rcvr)
 		bmk_sched_wake(viu->viu_rcvr);
 }
@@ -102,41 +102,68 @@ static void
 pusher(void *arg)
 {
 	struct virtif_user *viu = arg;
-	struct iovec iov;
-	struct onepkt *mypkt;
-	int flags;
+	int flags, n;
 
 	/* give us a rump kernel context */
 	rumpuser__hyp.hyp_schedule();
 	rumpuser__hyp.hyp_lwproc_newlwp(0);
 	rumpuser__hyp.hyp_unschedule();
 
-	local_irq_save(flags);
- again:
 	while (!viu->viu_dying) {
-		while (viu->viu_read == viu->viu_write) {
+		local_irq_save(flags);
+		while (!viu->viu_rxpending && !viu->viu_dying) {
 			viu->viu_rcvr = bmk_current;
 			bmk_sched_blockprepare();
 			local_irq_restore(flags);
 			bmk_sched_block();
 			local_irq_save(flags);
 			viu->viu_rcvr = NULL;
-			goto again;
 		}
-		mypkt = &viu->viu_pkts[viu->viu_read];
+		viu->viu_rxpending = 0;
 		local_irq_restore(flags);
 
-		iov.iov_base = mypkt->pkt_data;
-		iov.iov_len =  mypkt->pkt_dlen;
-
-		rumpuser__hyp.hyp_schedule();
-		rump_virtif_pktdeliver(viu->viu_vifsc, &iov, 1);
-		rumpuser__hyp.hyp_unschedule();
+		for (;;) {
+			rumpuser__hyp.hyp_schedule();
+			n = netfront_rxpoll(viu->viu_dev, viu->viu_budget);
+			rumpuser__hyp.hyp_unschedule();
+			if (n < viu->viu_budget || viu->viu_dying)
+				break;
+
+			/*
+			 * Let the stack process what we just gave it.
+			 * At our own priority yielding would just pick
+			 * us again, so poll at the default priority
+			 * until we have caught up.
+			 */
+			bmk_sched_setpri(bmk_current, BMK_SCHED_PRI_DEFAULT);
+			bmk_sched_yield();
+		}
+		bmk_sched_setpri(bmk_current, BMK_SCHED_PRI_INTR);
+	}
+}
 
-		local_irq_save(flags);
-		viu->viu_read = (viu->viu_read+1) % NBUF;
+static int
+getbudget(int devnum)
+{
+	char path[64];
+	char *err, *val;
+	int budget;
+
+	bmk_snprintf(path, sizeof(path),
+	    "device/vif/%d/rumprun-rx-budget", devnum);
+	if ((err = xenbus_read(XBT_NIL, path, &val)) != NULL) {
+		bmk_memfree(err, BMK_MEMWHO_WIREDBMK);
+		return RXBUDGET_DEFAULT;
 	}
-	local_irq_restore(flags);
+	budget = bmk_strtoul(val, NULL, 10);
+	if (budget <= 0) {
+		minios_printk("xenif%d: invalid rx budget \"%s\"\n",
+		    devnum, val);
+		budget = RXBUDGET_DEFAULT;
+	}
+	bmk_memfree(val, BMK_MEMWHO_WIREDBMK);
+
+	return budget;
 }
 
 int
@@ -155,8 +182,10 @@ VIFHYPER_CREATE(int devnum, struct virtif_sc *vif_sc, uint8_t *enaddr,
 	}
 	bmk_memset(viu, 0, sizeof(*viu));
 	viu->viu_vifsc = vif_sc;
+	viu->viu_budget = getbudget(devnum);
 
-	viu->viu_dev = netfront_init(NULL, myrecv, enaddr, NULL, viu);
+	viu->viu_dev = netfront_init_rxpoll(NULL, myrecv, myrecvnotify,
+	    enaddr, NULL, viu);
 	if (!viu->viu_dev) {
 		rv = BMK_EINVAL; /* ? */
 		bmk_memfree(viu, BMK_MEMWHO_RUMPKERN);
@@ -169,6 +198,7 @@ VIFHYPER_CREATE(int devnum, struct virtif_sc *vif_sc, uint8_t *enaddr,
 		minios_printk("fatal thread creation failure\n"); /* XXX */
 		minios_do_exit();
 	}
+	bmk_sched_setpri(viu->viu_thr, BMK_SCHED_PRI_INTR);
 
 	rv = 0;
 
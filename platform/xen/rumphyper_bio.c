@@ -356,6 +356,7 @@ rumpuser_bio(int fd, int op, void *data, size_t dlen, int64_t off,
 	int nlocks;
 	int num = fd - BLKFDOFF;
 	struct blkdev *bd = &blkdevs[num];
+	struct bmk_thread *thr;
 
 	rumpkern_unsched(&nlocks, NULL);
 
@@ -364,8 +365,9 @@ rumpuser_bio(int fd, int op, void *data, size_t dlen, int64_t off,
 		if (!bio_inited) {
 			bio_inited = 1;
 			rumpuser_mutex_exit(bio_mtx);
-			bmk_sched_create("biopoll", NULL, 0,
+			thr = bmk_sched_create("biopoll", NULL, 0,
 			    biothread, NULL, NULL, 0);
+			bmk_sched_setpri(thr, BMK_SCHED_PRI_INTR);
 		} else {
 			rumpuser_mutex_exit(bio_mtx);
 		}
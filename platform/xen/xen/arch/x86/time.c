@@ -200,6 +200,24 @@ bmk_platform_cpu_clock_epochoffset(void)
 	return rv;
 }
 
+/*
+ * The TSC may change rate or jump when the domain is migrated, so
+ * don't offer it as a counter.
+ */
+uint64_t
+bmk_platform_cpu_counter(void)
+{
+
+	return 0;
+}
+
+uint64_t
+bmk_platform_cpu_counter_freq(void)
+{
+
+	return 0;
+}
+
 void block_domain(s_time_t until)
 {
     ASSERT(irqs_disabled());
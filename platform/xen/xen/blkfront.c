@@ -41,6 +41,7 @@ struct blkfront_dev {
 
     struct blkif_front_ring ring;
     grant_ref_t ring_ref;
+    grant_ref_t gref_head;	/* reserved for request segments */
     evtchn_port_t evtchn;
     blkif_vdev_t handle;
 
@@ -64,6 +65,7 @@ static void free_blkfront(struct blkfront_dev *dev)
     bmk_memfree(dev->backend, BMK_MEMWHO_WIREDBMK);
 
     gnttab_end_access(dev->ring_ref);
+    gnttab_free_grant_references(dev->gref_head);
     bmk_pgfree_one(dev->ring.sring);
 
     minios_unbind_evtchn(dev->evtchn);
@@ -103,6 +105,14 @@ struct blkfront_dev *blkfront_init(char *_nodename, struct blkfront_info *info)
 
     dev->ring_ref = gnttab_grant_access(dev->dom,virt_to_mfn(s),0);
 
+    /* enough grants for a full ring, so we never wait for others */
+    if (gnttab_alloc_grant_references(
+      BLK_RING_SIZE * BLKIF_MAX_SEGMENTS_PER_REQUEST, &dev->gref_head) != 0) {
+        minios_printk("blkfront: cannot reserve grants\n");
+        err = NULL;
+        goto error;
+    }
+
     xenbus_event_queue_init(&dev->events);
 
 again:
@@ -314,6 +324,7 @@ void blkfront_aio(struct blkfront_aiocb *aiocbp, int write)
 {
     struct blkfront_dev *dev = aiocbp->aio_dev;
     struct blkif_request *req;
+    unsigned long frames[BLKIF_MAX_SEGMENTS_PER_REQUEST];
     RING_IDX i;
     int notify;
     int n, j;
@@ -357,9 +368,12 @@ void blkfront_aio(struct blkfront_aiocb *aiocbp, int write)
             *(char*)(data + (req->seg[j].first_sect << 9)) = 0;
             barrier();
         }
-	aiocbp->gref[j] = req->seg[j].gref =
-            gnttab_grant_access(dev->dom, virtual_to_mfn(data), write);
+	frames[j] = virtual_to_mfn(data);
     }
+    gnttab_grant_access_batch(&dev->gref_head, dev->dom, frames, n, write,
+      aiocbp->gref);
+    for (j = 0; j < n; j++)
+	req->seg[j].gref = aiocbp->gref[j];
 
     dev->ring.req_prod_pvt = i + 1;
 
@@ -486,14 +500,9 @@ moretodo:
         switch (rsp->operation) {
         case BLKIF_OP_READ:
         case BLKIF_OP_WRITE:
-        {
-            int j;
-
-            for (j = 0; j < aiocbp->n; j++)
-                gnttab_end_access(aiocbp->gref[j]);
-
+            gnttab_end_access_batch(&dev->gref_head,
+              aiocbp->gref, aiocbp->n);
             break;
-        }
 
         case BLKIF_OP_WRITE_BARRIER:
         case BLKIF_OP_FLUSH_DISKCACHE:
@@ -77,49 +77,42 @@ void xencons_tx(void)
 }
 
 
-void minios_console_print(struct consfront_dev *dev, char *data, int length)
+static void console_send(struct consfront_dev *dev, const char *data, int len)
 {
-    char *curr_char, saved_char;
-    char copied_str[length+1];
-    char *copied_ptr;
-    int part_len;
-    int (*ring_send_fn)(struct consfront_dev *dev, const char *data, unsigned length);
     int sent;
 
-    if(!console_initialised)
-        ring_send_fn = xencons_ring_send_no_notify;
-    else
-        ring_send_fn = xencons_ring_send;
+    sent = xencons_ring_send_no_notify(dev, data, len);
+
+    /* ring full, have the backend drain it (only possible once set up) */
+    if (sent < len && console_initialised)
+        xencons_ring_send(dev, data + sent, len - sent);
+}
+
+/*
+ * Translate \n to \r\n and put the data on the ring.  The backend is
+ * notified once for the whole batch instead of once per line.
+ */
+void minios_console_print(struct consfront_dev *dev, const char *data, int length)
+{
+    char buf[256];
+    int i, n;
 
-    copied_ptr = copied_str;
-    bmk_memcpy(copied_ptr, data, length);
-    for(curr_char = copied_ptr; curr_char < copied_ptr+length-1; curr_char++)
+    for (i = 0, n = 0; i < length; i++)
     {
-        if(*curr_char == '\n')
+        if (n >= (int)sizeof(buf) - 1)
         {
-            *curr_char = '\r';
-            saved_char = *(curr_char+1);
-            *(curr_char+1) = '\n';
-            part_len = curr_char - copied_ptr + 2;
-            ring_send_fn(dev, copied_ptr, part_len);
-            *(curr_char+1) = saved_char;
-            copied_ptr = curr_char+1;
-            length -= part_len - 1;
+            console_send(dev, buf, n);
+            n = 0;
         }
+        if (data[i] == '\n')
+            buf[n++] = '\r';
+        buf[n++] = data[i];
     }
+    if (n > 0)
+        console_send(dev, buf, n);
 
-    if (copied_ptr[length-1] == '\n') {
-        copied_ptr[length-1] = '\r';
-        copied_ptr[length] = '\n';
-        length++;
-    }
-    
-    /*
-     * we assume that the lower layer loops until it manages to
-     * send everything.  XXX is this the best place to do "buffering"?
-     */
-    sent = ring_send_fn(dev, copied_ptr, length);
-    ASSERT(ring_send_fn == xencons_ring_send_no_notify || sent == length);
+    if (console_initialised)
+        xencons_ring_notify(dev);
 }
 
 static void print(int direct, const char *fmt, va_list args)
@@ -142,11 +135,25 @@ static void print(int direct, const char *fmt, va_list args)
     }
 }
 
-/* XXX: should use a putc/flush combo ... later */
 void minios_putc(int c)
 {
+    char ch = c;
+
+    minios_console_write(&ch, 1);
+}
+
+/*
+ * Write out a batch of bmk_printf() output, see bmk_printf_setwrite().
+ */
+void minios_console_write(const char *data, unsigned long len)
+{
+
+#ifndef USE_XEN_CONSOLE
+    if(!console_initialised)
+#endif
+        (void)HYPERVISOR_console_io(CONSOLEIO_write, len, (char *)data);
 
-    minios_printk("%c", c);
+    minios_console_print(NULL, data, len);
 }
 
 void minios_printk(const char *fmt, ...)
@@ -177,6 +177,7 @@ done:
             goto error;
         }
     }
+    minios_evtchn_set_priority(dev->evtchn, MINIOS_EVTCHN_PRIO_LOW);
     minios_unmask_evtchn(dev->evtchn);
 
     minios_printk("**************************\n");
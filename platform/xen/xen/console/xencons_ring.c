@@ -78,6 +78,12 @@ int xencons_ring_send(struct consfront_dev *dev, const char *data, unsigned len)
 	return sent;
 }
 
+void xencons_ring_notify(struct consfront_dev *dev)
+{
+
+	notify_daemon(dev);
+}
+
 void console_handle_input(evtchn_port_t port, struct pt_regs *regs, void *data)
 {
 	struct consfront_dev *dev = (struct consfront_dev *) data;
@@ -125,6 +131,7 @@ struct consfront_dev *xencons_ring_init(void)
                 bmk_memfree(dev, BMK_MEMWHO_WIREDBMK);
 		return NULL;
 	}
+	minios_evtchn_set_priority(dev->evtchn, MINIOS_EVTCHN_PRIO_LOW);
         minios_unmask_evtchn(dev->evtchn);
 
 	/* In case we have in-flight data after save/restore... */
@@ -23,6 +23,10 @@
 #include <mini-os/lib.h>
 #include <mini-os/wait.h>
 
+#include <bmk-core/pgalloc.h>
+#include <bmk-core/sched.h>
+#include <bmk-core/string.h>
+
 #define NR_EVS 1024
 
 /* this represents a event handler. Chaining or sharing is not allowed */
@@ -30,7 +34,8 @@ typedef struct _ev_action_t {
     spinlock_t lock;
     evtchn_handler_t handler;
     void *data;
-    uint32_t count;
+    uint64_t count;
+    unsigned int prio;
 } ev_action_t;
 
 static ev_action_t ev_actions[NR_EVS];
@@ -38,6 +43,217 @@ void default_handler(evtchn_port_t port, struct pt_regs *regs, void *data);
 
 static unsigned long bound_ports[NR_EVS/(8*sizeof(unsigned long))];
 
+/* upcall statistics, see minios_evtchn_dumpstats() */
+static uint64_t ev_nupcalls, ev_nevents;
+static unsigned int ev_maxbatch;
+
+/*
+ * FIFO event channel ABI.  If Xen supports it, events are delivered
+ * through per-priority queues instead of the 2-level pending bitmap,
+ * so that e.g. network events are handled before xenstore and console
+ * events which were signalled earlier.  We only use vcpu 0 and ports
+ * below NR_EVS, which fit in a single event array page.
+ */
+int minios_evtchn_fifo;
+
+#ifdef EVTCHNOP_init_control
+static struct evtchn_fifo_control_block *fifo_control;
+static event_word_t *fifo_words;
+static uint32_t fifo_head[EVTCHN_FIFO_MAX_QUEUES];
+
+#define FIFO_BIT(b) ((event_word_t)1 << (b))
+
+static int fifo_init(void)
+{
+    struct evtchn_init_control init;
+    struct evtchn_expand_array expand;
+    unsigned int i;
+    int rc;
+
+    BUG_ON(NR_EVS > PAGE_SIZE / sizeof(event_word_t));
+
+    fifo_control = bmk_pgalloc_one();
+    fifo_words = bmk_pgalloc_one();
+    if (fifo_control == NULL || fifo_words == NULL)
+        goto fail;
+
+    bmk_memset(fifo_control, 0, PAGE_SIZE);
+    for (i = 0; i < PAGE_SIZE / sizeof(event_word_t); i++)
+        fifo_words[i] = FIFO_BIT(EVTCHN_FIFO_MASKED);
+
+    init.control_gfn = virt_to_mfn(fifo_control);
+    init.offset = 0;
+    init.vcpu = 0;
+    if (HYPERVISOR_event_channel_op(EVTCHNOP_init_control, &init) != 0)
+        goto fail;
+
+    /* there is no way back to 2-level after init_control */
+    expand.array_gfn = virt_to_mfn(fifo_words);
+    if ((rc = HYPERVISOR_event_channel_op(EVTCHNOP_expand_array,
+      &expand)) != 0) {
+        minios_printk("FATAL: cannot set up FIFO event array: %d\n", rc);
+        BUG();
+    }
+
+    return 1;
+
+ fail:
+    if (fifo_control)
+        bmk_pgfree_one(fifo_control);
+    if (fifo_words)
+        bmk_pgfree_one(fifo_words);
+    fifo_control = NULL;
+    fifo_words = NULL;
+    return 0;
+}
+
+void minios_evtchn_fifo_mask(evtchn_port_t port)
+{
+    synch_set_bit(EVTCHN_FIFO_MASKED, &fifo_words[port]);
+}
+
+void minios_evtchn_fifo_unmask(evtchn_port_t port)
+{
+    struct evtchn_unmask unmask;
+
+    synch_clear_bit(EVTCHN_FIFO_MASKED, &fifo_words[port]);
+
+    /* Xen links the event into its queue if it became pending */
+    if (synch_test_bit(EVTCHN_FIFO_PENDING, &fifo_words[port])) {
+        unmask.port = port;
+        HYPERVISOR_event_channel_op(EVTCHNOP_unmask, &unmask);
+    }
+}
+
+void minios_evtchn_fifo_clear(evtchn_port_t port)
+{
+    synch_clear_bit(EVTCHN_FIFO_PENDING, &fifo_words[port]);
+}
+
+/*
+ * Take the event at the head of queue q.  Returns the port, or
+ * -1 if the event was masked or no longer pending.
+ */
+static int fifo_consume(unsigned int q, uint32_t *ready)
+{
+    event_word_t *word, w;
+    uint32_t head;
+    evtchn_port_t port;
+
+    head = fifo_head[q];
+    if (head == 0) {
+        /* the queue was empty, see if Xen has added to it */
+        rmb();
+        head = fifo_control->head[q];
+    }
+
+    port = head;
+    word = &fifo_words[port];
+
+    /* unlink the event and find the next one in the queue */
+    do {
+        w = *word;
+    } while (synch_cmpxchg(word, w,
+      w & ~(FIFO_BIT(EVTCHN_FIFO_LINKED) | EVTCHN_FIFO_LINK_MASK)) != w);
+    head = w & EVTCHN_FIFO_LINK_MASK;
+    if (head == 0)
+        *ready &= ~(1U << q);
+    fifo_head[q] = head;
+
+    if (!(w & FIFO_BIT(EVTCHN_FIFO_PENDING))
+      || (w & FIFO_BIT(EVTCHN_FIFO_MASKED)))
+        return -1;
+    return port;
+}
+
+/*
+ * Drain the queues.  One event is taken at a time from the highest
+ * priority queue with events, so that higher priority events arriving
+ * meanwhile are handled before the rest of the lower priority ones.
+ */
+void minios_evtchn_fifo_upcall(struct pt_regs *regs)
+{
+    uint32_t ready;
+    unsigned int n = 0;
+    int port;
+
+    ready = xchg(&fifo_control->ready, 0);
+    while (ready) {
+        if ((port = fifo_consume(__ffs(ready), &ready)) != -1) {
+            minios_evtchn_fifo_clear(port);
+            minios_evtchn_deliver(port, regs);
+            n++;
+        }
+        ready |= xchg(&fifo_control->ready, 0);
+    }
+    minios_evtchn_upcall_done(n);
+}
+#else /* !EVTCHNOP_init_control */
+static int fifo_init(void)
+{
+    return 0;
+}
+
+void minios_evtchn_fifo_mask(evtchn_port_t port) {}
+void minios_evtchn_fifo_unmask(evtchn_port_t port) {}
+void minios_evtchn_fifo_clear(evtchn_port_t port) {}
+void minios_evtchn_fifo_upcall(struct pt_regs *regs) {}
+#endif /* EVTCHNOP_init_control */
+
+/*
+ * Set the priority of a port.  Only the FIFO ABI has priorities,
+ * so this is a no-op with the 2-level ABI.
+ */
+int minios_evtchn_set_priority(evtchn_port_t port, unsigned int prio)
+{
+#ifdef EVTCHNOP_init_control
+    struct evtchn_set_priority op;
+    int rc;
+
+    if (port >= NR_EVS)
+        return -1;
+    ev_actions[port].prio = prio;
+    if (!minios_evtchn_fifo)
+        return 0;
+
+    op.port = port;
+    op.priority = prio;
+    if ((rc = HYPERVISOR_event_channel_op(EVTCHNOP_set_priority, &op)) != 0)
+        minios_printk("WARN: set_priority %d for port %d failed rc=%d\n",
+          prio, port, rc);
+    return rc;
+#else
+    if (port < NR_EVS)
+        ev_actions[port].prio = prio;
+    return 0;
+#endif
+}
+
+void minios_evtchn_upcall_done(unsigned int nevents)
+{
+    ev_nupcalls++;
+    ev_nevents += nevents;
+    if (nevents > ev_maxbatch)
+        ev_maxbatch = nevents;
+}
+
+void minios_evtchn_dumpstats(void)
+{
+    int i;
+
+    minios_printk("event channels: %s ABI, %llu upcalls, "
+      "%llu events, max %u per upcall\n",
+      minios_evtchn_fifo ? "FIFO" : "2-level",
+      (unsigned long long)ev_nupcalls, (unsigned long long)ev_nevents,
+      ev_maxbatch);
+    for (i = 0; i < NR_EVS; i++) {
+        if (ev_actions[i].count == 0)
+            continue;
+        minios_printk("  port %4d: prio %2u, %llu events\n",
+          i, ev_actions[i].prio, (unsigned long long)ev_actions[i].count);
+    }
+}
+
 static void (*rump_evtdev_callback)(u_int port);
 
 void minios_events_register_rump_callback(void (*cb)(u_int))
@@ -107,25 +323,36 @@ void unbind_all_ports(void)
  */
 int do_event(evtchn_port_t port, struct pt_regs *regs)
 {
-    ev_action_t  *action;
 
     minios_clear_evtchn(port);
+    minios_evtchn_deliver(port, regs);
+
+    return 1;
+}
+
+/*
+ * Call the handler of a port whose pending bit the caller has already
+ * cleared.  This runs for every event, so the port lock is not taken:
+ * handler and data are published in an order which is safe for the
+ * (single vcpu) upcall, see minios_bind_evtchn().
+ */
+void minios_evtchn_deliver(evtchn_port_t port, struct pt_regs *regs)
+{
+    ev_action_t  *action;
 
     if (port >= NR_EVS)
     {
         minios_printk("WARN: do_event(): Port number too large: %d\n", port);
-        return 1;
+        return;
     }
 
-    spin_lock(&ev_actions[port].lock);
     action = &ev_actions[port];
     action->count++;
 
     /* call the handler */
+    bmk_sched_trace_intr(port, 0);
     action->handler(port, regs, action->data);
-    spin_unlock(&ev_actions[port].lock);
-
-    return 1;
+    bmk_sched_trace_intr(port, 1);
 }
 
 evtchn_port_t minios_bind_evtchn(evtchn_port_t port, evtchn_handler_t handler,
@@ -160,6 +387,7 @@ void minios_unbind_evtchn(evtchn_port_t port)
     ev_actions[port].handler = default_handler;
     wmb();
     ev_actions[port].data = NULL;
+    ev_actions[port].prio = MINIOS_EVTCHN_PRIO_DEFAULT;
     spin_unlock(&ev_actions[port].lock);
 
     clear_bit(port, bound_ports);
@@ -241,9 +469,16 @@ void init_events(void)
     for ( i = 0; i < NR_EVS; i++ )
     {
         ev_actions[i].handler = default_handler;
+        ev_actions[i].prio = MINIOS_EVTCHN_PRIO_DEFAULT;
         spin_lock_init(&ev_actions[i].lock);
         minios_mask_evtchn(i);
     }
+
+    /* all ports are masked, so nothing is lost switching ABI */
+    if (fifo_init()) {
+        minios_evtchn_fifo = 1;
+        minios_printk("Using FIFO event channels.\n");
+    }
 }
 
 void fini_events(void)
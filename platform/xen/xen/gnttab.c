@@ -18,55 +18,313 @@
 #include <mini-os/os.h>
 #include <mini-os/mm.h>
 #include <mini-os/gnttab.h>
-#include <mini-os/semaphore.h>
+#include <mini-os/wait.h>
 
 #include <bmk-core/pgalloc.h>
 #include <bmk-core/string.h>
 
 #define NR_RESERVED_ENTRIES 8
 
-/* NR_GRANT_FRAMES must be less than or equal to that configured in Xen */
+/*
+ * The table starts out with NR_GRANT_FRAMES and is grown on demand,
+ * up to what Xen allows us (GNTTABOP_query_size) but no more than
+ * NR_GRANT_FRAMES_MAX.  Frames are mapped as they are added, so the
+ * table is not virtually contiguous and entries are found per frame.
+ */
 #define NR_GRANT_FRAMES 4
-#define NR_GRANT_ENTRIES (NR_GRANT_FRAMES * PAGE_SIZE / sizeof(grant_entry_t))
+#define NR_GRANT_FRAMES_MAX 32
+#define GREFS_PER_FRAME (PAGE_SIZE / sizeof(grant_entry_t))
+#define NR_GRANT_ENTRIES_MAX (NR_GRANT_FRAMES_MAX * GREFS_PER_FRAME)
+
+/* terminates the free list and reservations, never a valid reference */
+#define GNTTAB_LIST_END 0
 
-static grant_entry_t *gnttab_table;
-static grant_ref_t gnttab_list[NR_GRANT_ENTRIES];
+static grant_entry_t *gnttab_frames[NR_GRANT_FRAMES_MAX];
+static unsigned int gnttab_nr_frames, gnttab_max_frames;
+
+static grant_ref_t gnttab_list[NR_GRANT_ENTRIES_MAX];
+static unsigned int gnttab_nfree;
+static DECLARE_WAIT_QUEUE_HEAD(gnttab_waitq);
 #ifdef GNT_DEBUG
-static char inuse[NR_GRANT_ENTRIES];
+static char inuse[NR_GRANT_ENTRIES_MAX];
 #endif
-static __DECLARE_SEMAPHORE_GENERIC(gnttab_sem, 0);
 
+static inline grant_entry_t *
+gnttab_entry(grant_ref_t ref)
+{
+
+    BUG_ON(ref < NR_RESERVED_ENTRIES
+      || ref >= gnttab_nr_frames * GREFS_PER_FRAME);
+    return &gnttab_frames[ref / GREFS_PER_FRAME][ref % GREFS_PER_FRAME];
+}
+
+/* call with interrupts disabled */
 static void
 put_free_entry(grant_ref_t ref)
 {
-    unsigned long flags;
-    local_irq_save(flags);
+
 #ifdef GNT_DEBUG
     BUG_ON(!inuse[ref]);
     inuse[ref] = 0;
 #endif
     gnttab_list[ref] = gnttab_list[0];
     gnttab_list[0]  = ref;
+    gnttab_nfree++;
+}
+
+static void
+free_entry(grant_ref_t ref)
+{
+    unsigned long flags;
+
+    local_irq_save(flags);
+    put_free_entry(ref);
+    minios_wake_up(&gnttab_waitq);
     local_irq_restore(flags);
-    up(&gnttab_sem);
 }
 
+/*
+ * Grow the table to nr_frames.  Call with interrupts disabled.
+ * Returns the number of frames added.
+ */
+static unsigned int
+gnttab_grow(unsigned int nr_frames)
+{
+    struct gnttab_setup_table setup;
+    unsigned long frames[NR_GRANT_FRAMES_MAX];
+    unsigned int i, old = gnttab_nr_frames;
+    grant_ref_t ref;
+    char *va;
+    int rc;
+
+    if (nr_frames > gnttab_max_frames)
+        nr_frames = gnttab_max_frames;
+    if (nr_frames <= old)
+        return 0;
+
+    setup.dom = DOMID_SELF;
+    setup.nr_frames = nr_frames;
+    set_xen_guest_handle(setup.frame_list, frames);
+
+    if ((rc = HYPERVISOR_grant_table_op(GNTTABOP_setup_table,
+      &setup, 1)) != 0 || setup.status != GNTST_okay) {
+        minios_printk("gnttab: cannot grow to %u frames: %s\n", nr_frames,
+          rc ? "hypercall failed" : gnttabop_error(setup.status));
+        gnttab_max_frames = old;
+        return 0;
+    }
+
+    /* Xen returns the whole table, map only the new frames */
+    va = map_frames(frames + old, nr_frames - old);
+    if (va == NULL) {
+        gnttab_max_frames = old;
+        return 0;
+    }
+    for (i = old; i < nr_frames; i++)
+        gnttab_frames[i] = (grant_entry_t *)(va + (i - old) * PAGE_SIZE);
+    gnttab_nr_frames = nr_frames;
+
+    ref = old * GREFS_PER_FRAME;
+    if (ref < NR_RESERVED_ENTRIES)
+        ref = NR_RESERVED_ENTRIES;
+    for (; ref < nr_frames * GREFS_PER_FRAME; ref++)
+        put_free_entry(ref);
+    minios_wake_up(&gnttab_waitq);
+
+    return nr_frames - old;
+}
+
+/*
+ * Take n entries off the free list into a chain linked through
+ * gnttab_list.  Grows the table if there are not enough free entries,
+ * and sleeps until enough are freed if it cannot be grown.
+ */
 static grant_ref_t
-get_free_entry(void)
+get_free_entries(unsigned int n)
 {
-    unsigned int ref;
     unsigned long flags;
-    down(&gnttab_sem);
+    unsigned int i, want;
+    grant_ref_t head, ref;
+
+    BUG_ON(n == 0 || n > NR_GRANT_ENTRIES_MAX - NR_RESERVED_ENTRIES);
+
     local_irq_save(flags);
-    ref = gnttab_list[0];
-    BUG_ON(ref < NR_RESERVED_ENTRIES || ref >= NR_GRANT_ENTRIES);
-    gnttab_list[0] = gnttab_list[ref];
+    while (gnttab_nfree < n) {
+        want = gnttab_nr_frames * 2;
+        while ((want - gnttab_nr_frames) * GREFS_PER_FRAME
+          < n - gnttab_nfree)
+            want++;
+        if (gnttab_grow(want) > 0)
+            continue;
+
+        local_irq_restore(flags);
+        minios_wait_event(gnttab_waitq, gnttab_nfree >= n);
+        local_irq_save(flags);
+    }
+
+    head = ref = gnttab_list[0];
+    for (i = 0; i < n; i++) {
+        BUG_ON(ref < NR_RESERVED_ENTRIES
+          || ref >= gnttab_nr_frames * GREFS_PER_FRAME);
 #ifdef GNT_DEBUG
-    BUG_ON(inuse[ref]);
-    inuse[ref] = 1;
+        BUG_ON(inuse[ref]);
+        inuse[ref] = 1;
 #endif
+        gnttab_list[0] = gnttab_list[ref];
+        if (i == n-1)
+            gnttab_list[ref] = GNTTAB_LIST_END;
+        ref = gnttab_list[0];
+    }
+    gnttab_nfree -= n;
     local_irq_restore(flags);
-    return ref;
+
+    return head;
+}
+
+static void
+set_entry(grant_ref_t ref, domid_t domid, unsigned long frame, uint16_t flags)
+{
+    grant_entry_t *ent = gnttab_entry(ref);
+
+    ent->frame = frame;
+    ent->domid = domid;
+    wmb();
+    ent->flags = flags;
+}
+
+static int
+end_entry(grant_ref_t ref)
+{
+    grant_entry_t *ent = gnttab_entry(ref);
+    uint16_t flags, nflags;
+
+    nflags = ent->flags;
+    do {
+        if ((flags = nflags) & (GTF_reading|GTF_writing)) {
+            minios_printk("WARNING: g.e. still in use! (%x)\n", flags);
+            return 0;
+        }
+    } while ((nflags = synch_cmpxchg(&ent->flags, flags, 0)) != flags);
+
+    return 1;
+}
+
+/*
+ * Reserve count entries for a consumer.  The entries are chained from
+ * *head and are used with the _batch routines, so that a consumer which
+ * sized its reservation for its worst case is never starved by others
+ * and never sleeps waiting for a grant.
+ */
+int
+gnttab_alloc_grant_references(uint16_t count, grant_ref_t *head)
+{
+
+    if (count == 0 || count > NR_GRANT_ENTRIES_MAX - NR_RESERVED_ENTRIES)
+        return -1;
+    *head = get_free_entries(count);
+    return 0;
+}
+
+void
+gnttab_free_grant_references(grant_ref_t head)
+{
+    unsigned long flags;
+    grant_ref_t ref;
+
+    local_irq_save(flags);
+    while ((ref = head) != GNTTAB_LIST_END) {
+        head = gnttab_list[ref];
+        put_free_entry(ref);
+    }
+    minios_wake_up(&gnttab_waitq);
+    local_irq_restore(flags);
+}
+
+/*
+ * Grant access to n frames.  The references are taken from the
+ * reservation at *head, or from the global free list if head is NULL.
+ * Should the reservation have run short because entries leaked
+ * and could not be replaced, the rest come from the free list.
+ */
+void
+gnttab_grant_access_batch(grant_ref_t *head, domid_t domid,
+    const unsigned long *frames, int n, int readonly, grant_ref_t *refs)
+{
+    unsigned long flags;
+    grant_ref_t ref;
+    int i;
+
+    if (head == NULL) {
+        ref = get_free_entries(n);
+        for (i = 0; i < n; i++) {
+            refs[i] = ref;
+            ref = gnttab_list[ref];
+        }
+    } else {
+        local_irq_save(flags);
+        for (i = 0; i < n && *head != GNTTAB_LIST_END; i++) {
+            refs[i] = *head;
+            *head = gnttab_list[*head];
+        }
+        local_irq_restore(flags);
+        if (i < n) {
+            minios_printk("gnttab: reservation exhausted\n");
+            ref = get_free_entries(n - i);
+            for (; i < n; i++) {
+                refs[i] = ref;
+                ref = gnttab_list[ref];
+            }
+        }
+    }
+
+    for (i = 0; i < n; i++)
+        set_entry(refs[i], domid, frames[i],
+          GTF_permit_access | (readonly ? GTF_readonly : 0));
+}
+
+/*
+ * End access to n grants, returning the references to the reservation
+ * at *head, or to the global free list if head is NULL.  Entries still
+ * in use by the remote end are leaked, as with gnttab_end_access().
+ * A leaked entry is replaced in the reservation from the free list if
+ * one is available.  Returns the number of grants ended.
+ */
+int
+gnttab_end_access_batch(grant_ref_t *head, const grant_ref_t *refs, int n)
+{
+    unsigned long flags;
+    grant_ref_t ref;
+    int i, nended = 0;
+
+    local_irq_save(flags);
+    for (i = 0; i < n; i++) {
+        if (!end_entry(refs[i])) {
+            if (head && gnttab_nfree > 0) {
+                ref = gnttab_list[0];
+#ifdef GNT_DEBUG
+                BUG_ON(inuse[ref]);
+                inuse[ref] = 1;
+#endif
+                gnttab_list[0] = gnttab_list[ref];
+                gnttab_nfree--;
+                gnttab_list[ref] = *head;
+                *head = ref;
+            }
+            continue;
+        }
+        if (head) {
+            gnttab_list[refs[i]] = *head;
+            *head = refs[i];
+        } else {
+            put_free_entry(refs[i]);
+        }
+        nended++;
+    }
+    if (head == NULL && nended)
+        minios_wake_up(&gnttab_waitq);
+    local_irq_restore(flags);
+
+    return nended;
 }
 
 grant_ref_t
@@ -74,13 +332,7 @@ gnttab_grant_access(domid_t domid, unsigned long frame, int readonly)
 {
     grant_ref_t ref;
 
-    ref = get_free_entry();
-    gnttab_table[ref].frame = frame;
-    gnttab_table[ref].domid = domid;
-    wmb();
-    readonly *= GTF_readonly;
-    gnttab_table[ref].flags = GTF_permit_access | readonly;
-
+    gnttab_grant_access_batch(NULL, domid, &frame, 1, readonly, &ref);
     return ref;
 }
 
@@ -89,11 +341,8 @@ gnttab_grant_transfer(domid_t domid, unsigned long pfn)
 {
     grant_ref_t ref;
 
-    ref = get_free_entry();
-    gnttab_table[ref].frame = pfn;
-    gnttab_table[ref].domid = domid;
-    wmb();
-    gnttab_table[ref].flags = GTF_accept_transfer;
+    ref = get_free_entries(1);
+    set_entry(ref, domid, pfn, GTF_accept_transfer);
 
     return ref;
 }
@@ -101,49 +350,35 @@ gnttab_grant_transfer(domid_t domid, unsigned long pfn)
 int
 gnttab_end_access(grant_ref_t ref)
 {
-    uint16_t flags, nflags;
-
-    BUG_ON(ref >= NR_GRANT_ENTRIES || ref < NR_RESERVED_ENTRIES);
-
-    nflags = gnttab_table[ref].flags;
-    do {
-        if ((flags = nflags) & (GTF_reading|GTF_writing)) {
-            minios_printk("WARNING: g.e. still in use! (%x)\n", flags);
-            return 0;
-        }
-    } while ((nflags = synch_cmpxchg(&gnttab_table[ref].flags, flags, 0)) !=
-            flags);
 
-    put_free_entry(ref);
-    return 1;
+    return gnttab_end_access_batch(NULL, &ref, 1);
 }
 
 unsigned long
 gnttab_end_transfer(grant_ref_t ref)
 {
+    grant_entry_t *ent = gnttab_entry(ref);
     unsigned long frame;
     uint16_t flags;
 
-    BUG_ON(ref >= NR_GRANT_ENTRIES || ref < NR_RESERVED_ENTRIES);
-
-    while (!((flags = gnttab_table[ref].flags) & GTF_transfer_committed)) {
-        if (synch_cmpxchg(&gnttab_table[ref].flags, flags, 0) == flags) {
+    while (!((flags = ent->flags) & GTF_transfer_committed)) {
+        if (synch_cmpxchg(&ent->flags, flags, 0) == flags) {
             minios_printk("Release unused transfer grant.\n");
-            put_free_entry(ref);
+            free_entry(ref);
             return 0;
         }
     }
 
     /* If a transfer is in progress then wait until it is completed. */
     while (!(flags & GTF_transfer_completed)) {
-        flags = gnttab_table[ref].flags;
+        flags = ent->flags;
     }
 
     /* Read the frame number /after/ reading completion status. */
     rmb();
-    frame = gnttab_table[ref].frame;
+    frame = ent->frame;
 
-    put_free_entry(ref);
+    free_entry(ref);
 
     return frame;
 }
@@ -175,23 +410,29 @@ gnttabop_error(int16_t status)
 void
 init_gnttab(void)
 {
-    struct gnttab_setup_table setup;
-    unsigned long frames[NR_GRANT_FRAMES];
-    int i;
+    struct gnttab_query_size query;
+    unsigned long flags;
 
 #ifdef GNT_DEBUG
     bmk_memset(inuse, 1, sizeof(inuse));
 #endif
-    for (i = NR_RESERVED_ENTRIES; i < NR_GRANT_ENTRIES; i++)
-        put_free_entry(i);
 
-    setup.dom = DOMID_SELF;
-    setup.nr_frames = NR_GRANT_FRAMES;
-    set_xen_guest_handle(setup.frame_list, frames);
+    query.dom = DOMID_SELF;
+    if (HYPERVISOR_grant_table_op(GNTTABOP_query_size, &query, 1) == 0
+      && query.status == GNTST_okay) {
+        gnttab_max_frames = query.max_nr_frames;
+        if (gnttab_max_frames > NR_GRANT_FRAMES_MAX)
+            gnttab_max_frames = NR_GRANT_FRAMES_MAX;
+    } else {
+        gnttab_max_frames = NR_GRANT_FRAMES;
+    }
 
-    HYPERVISOR_grant_table_op(GNTTABOP_setup_table, &setup, 1);
-    gnttab_table = map_frames(frames, NR_GRANT_FRAMES);
-    minios_printk("gnttab_table mapped at %p.\n", gnttab_table);
+    local_irq_save(flags);
+    if (gnttab_grow(NR_GRANT_FRAMES) == 0)
+        minios_printk("gnttab: cannot set up grant table!\n");
+    local_irq_restore(flags);
+    minios_printk("gnttab: %u frames, up to %u.\n",
+      gnttab_nr_frames, gnttab_max_frames);
 }
 
 void
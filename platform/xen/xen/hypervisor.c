@@ -36,10 +36,24 @@
 
 int _minios_in_hypervisor_callback;
 
+/*
+ * Clear the given pending bits of a selector word with one atomic op.
+ */
+static inline void clear_pending(shared_info_t *s, unsigned long idx,
+                                 unsigned long bits)
+{
+    unsigned long pend;
+
+    do {
+        pend = s->evtchn_pending[idx];
+    } while (synch_cmpxchg(&s->evtchn_pending[idx], pend, pend & ~bits)
+      != pend);
+}
+
 void _minios_do_hypervisor_callback(struct pt_regs *regs)
 {
     unsigned long  l1, l2, l1i, l2i;
-    unsigned int   port;
+    unsigned int   port, n = 0;
     int            cpu = 0;
     shared_info_t *s = HYPERVISOR_shared_info;
     vcpu_info_t   *vcpu_info = &s->vcpu_info[cpu];
@@ -52,21 +66,42 @@ void _minios_do_hypervisor_callback(struct pt_regs *regs)
     /* Clear master flag /before/ clearing selector flag. */
     wmb();
 #endif
+    if (minios_evtchn_fifo) {
+        minios_evtchn_fifo_upcall(regs);
+        _minios_in_hypervisor_callback = 0;
+        return;
+    }
+
     l1 = xchg(&vcpu_info->evtchn_pending_sel, 0);
     while ( l1 != 0 )
     {
         l1i = __ffs(l1);
         l1 &= ~(1UL << l1i);
         
+        /*
+         * Acknowledge all active ports of the word at once instead
+         * of one locked op per port.  A handler may mask a port
+         * later in the batch, in which case the event is left
+         * pending for minios_unmask_evtchn() to resend.
+         */
         while ( (l2 = active_evtchns(cpu, s, l1i)) != 0 )
         {
-            l2i = __ffs(l2);
-            l2 &= ~(1UL << l2i);
-
-            port = (l1i * (sizeof(unsigned long) * 8)) + l2i;
-			do_event(port, regs);
+            clear_pending(s, l1i, l2);
+            do {
+                l2i = __ffs(l2);
+                l2 &= ~(1UL << l2i);
+
+                port = (l1i * (sizeof(unsigned long) * 8)) + l2i;
+                if (synch_test_bit(port, &s->evtchn_mask[0])) {
+                    synch_set_bit(port, &s->evtchn_pending[0]);
+                    continue;
+                }
+                minios_evtchn_deliver(port, regs);
+                n++;
+            } while ( l2 != 0 );
         }
     }
+    minios_evtchn_upcall_done(n);
 
     _minios_in_hypervisor_callback = 0;
 }
@@ -91,6 +126,11 @@ void minios_force_evtchn_callback(void)
 inline void minios_mask_evtchn(uint32_t port)
 {
     shared_info_t *s = HYPERVISOR_shared_info;
+
+    if (minios_evtchn_fifo) {
+        minios_evtchn_fifo_mask(port);
+        return;
+    }
     synch_set_bit(port, &s->evtchn_mask[0]);
 }
 
@@ -99,6 +139,10 @@ inline void minios_unmask_evtchn(uint32_t port)
     shared_info_t *s = HYPERVISOR_shared_info;
     vcpu_info_t *vcpu_info = &s->vcpu_info[smp_processor_id()];
 
+    if (minios_evtchn_fifo) {
+        minios_evtchn_fifo_unmask(port);
+        return;
+    }
     synch_clear_bit(port, &s->evtchn_mask[0]);
 
     /*
@@ -118,6 +162,11 @@ inline void minios_unmask_evtchn(uint32_t port)
 inline void minios_clear_evtchn(uint32_t port)
 {
     shared_info_t *s = HYPERVISOR_shared_info;
+
+    if (minios_evtchn_fifo) {
+        minios_evtchn_fifo_clear(port);
+        return;
+    }
     synch_clear_bit(port, &s->evtchn_pending[0]);
 }
 
@@ -63,6 +63,7 @@ struct consfront_dev {
 
 void minios_printk(const char *fmt, ...);
 void minios_putc(int);
+void minios_console_write(const char *data, unsigned long len);
 void xprintk(const char *fmt, ...);
 void panic(const char *fmt, ...);
 
@@ -72,7 +73,7 @@ void xencons_rx(char *buf, unsigned len, struct pt_regs *regs);
 void xencons_tx(void);
 
 void init_console(void);
-void minios_console_print(struct consfront_dev *dev, char *data, int length);
+void minios_console_print(struct consfront_dev *dev, const char *data, int length);
 void fini_console(struct consfront_dev *dev);
 
 /* Low level functions defined in xencons_ring.c */
@@ -81,6 +82,7 @@ struct consfront_dev *xencons_ring_init(void);
 struct consfront_dev *init_consfront(char *_nodename);
 int xencons_ring_send(struct consfront_dev *dev, const char *data, unsigned len);
 int xencons_ring_send_no_notify(struct consfront_dev *dev, const char *data, unsigned len);
+void xencons_ring_notify(struct consfront_dev *dev);
 int xencons_ring_avail(struct consfront_dev *dev);
 int xencons_ring_recv(struct consfront_dev *dev, char *data, unsigned len);
 void free_consfront(struct consfront_dev *dev);
@@ -24,8 +24,27 @@
 struct pt_regs;
 typedef void (*evtchn_handler_t)(evtchn_port_t, struct pt_regs *, void *);
 
+/*
+ * Event channel priorities, lower is more urgent.  They only have an
+ * effect when the FIFO ABI is in use.
+ */
+#define MINIOS_EVTCHN_PRIO_HIGH		4
+#define MINIOS_EVTCHN_PRIO_DEFAULT	7
+#define MINIOS_EVTCHN_PRIO_LOW		10
+
 /* prototypes */
 int do_event(evtchn_port_t port, struct pt_regs *regs);
+void minios_evtchn_deliver(evtchn_port_t port, struct pt_regs *regs);
+void minios_evtchn_upcall_done(unsigned int nevents);
+int minios_evtchn_set_priority(evtchn_port_t port, unsigned int prio);
+void minios_evtchn_dumpstats(void);
+
+/* FIFO ABI, used by hypervisor.c if minios_evtchn_fifo is set */
+extern int minios_evtchn_fifo;
+void minios_evtchn_fifo_mask(evtchn_port_t port);
+void minios_evtchn_fifo_unmask(evtchn_port_t port);
+void minios_evtchn_fifo_clear(evtchn_port_t port);
+void minios_evtchn_fifo_upcall(struct pt_regs *regs);
 evtchn_port_t minios_bind_virq(uint32_t virq, evtchn_handler_t handler, void *data);
 evtchn_port_t minios_bind_pirq(uint32_t pirq, int will_share, evtchn_handler_t handler, void *data);
 evtchn_port_t minios_bind_evtchn(evtchn_port_t port, evtchn_handler_t handler,
@@ -10,6 +10,15 @@ grant_ref_t gnttab_grant_access(domid_t domid, unsigned long frame,
 grant_ref_t gnttab_grant_transfer(domid_t domid, unsigned long pfn);
 unsigned long gnttab_end_transfer(grant_ref_t gref);
 int gnttab_end_access(grant_ref_t ref);
+
+int gnttab_alloc_grant_references(uint16_t count, grant_ref_t *head);
+void gnttab_free_grant_references(grant_ref_t head);
+void gnttab_grant_access_batch(grant_ref_t *head, domid_t domid,
+				const unsigned long *frames, int n,
+				int readonly, grant_ref_t *refs);
+int gnttab_end_access_batch(grant_ref_t *head, const grant_ref_t *refs,
+			    int n);
+
 const char *gnttabop_error(int16_t status);
 void fini_gnttab(void);
 
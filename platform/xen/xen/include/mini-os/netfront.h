@@ -4,6 +4,8 @@
 #include <mini-os/wait.h>
 struct netfront_dev;
 struct netfront_dev *netfront_init(char *nodename, void (*netif_rx)(struct netfront_dev *, unsigned char *data, int len), unsigned char rawmac[6], char **ip, void *priv);
+struct netfront_dev *netfront_init_rxpoll(char *nodename, void (*netif_rx)(struct netfront_dev *, unsigned char *data, int len), void (*netif_rx_notify)(struct netfront_dev *), unsigned char rawmac[6], char **ip, void *priv);
+int netfront_rxpoll(struct netfront_dev *dev, int budget);
 void netfront_xmit(struct netfront_dev *dev, unsigned char* data,int len);
 void netfront_shutdown(struct netfront_dev *dev);
 
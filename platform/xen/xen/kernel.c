@@ -44,6 +44,8 @@
 #include <xen/version.h>
 
 #include <bmk-core/core.h>
+#include <bmk-core/errno.h>
+#include <bmk-core/platform.h>
 #include <bmk-core/printf.h>
 
 uint8_t _minios_xen_features[XENFEAT_NR_SUBMAPS * 32];
@@ -80,6 +82,7 @@ void
 bmk_platform_halt(const char *panicstring)
 {
 
+	bmk_printf_flush();
 	if (panicstring)
 		minios_printk("PANIC: %s\n", panicstring);
 	minios_stop_kernel();
@@ -110,6 +113,22 @@ bmk_platform_splx(unsigned long x)
 	local_irq_restore(x);
 }
 
+/* Xen has no PV entropy device, so use what the cpu provides */
+unsigned long
+bmk_platform_getentropy(void *buf, unsigned long len)
+{
+
+	return bmk_cpu_getentropy(buf, len);
+}
+
+/* save/restore would need to reconnect the PV devices, not done yet */
+int
+bmk_platform_snapshot(void)
+{
+
+	return BMK_ENOSYS;
+}
+
 /*
  * INITIAL C ENTRY POINT.
  */
@@ -117,6 +136,7 @@ void _minios_start_kernel(start_info_t *si)
 {
 
     bmk_printf_init(minios_putc, NULL);
+    bmk_printf_setwrite(minios_console_write);
     bmk_core_init(STACK_SIZE_PAGE_ORDER);
 
     arch_init(si);
@@ -219,6 +239,7 @@ void minios_do_halt(int reason)
 
 void minios_do_exit(void)
 {
+    bmk_printf_flush();
     minios_printk("Do_exit called!\n");
     stack_walk();
     for( ;; )
@@ -47,6 +47,7 @@ struct netfront_dev {
     struct netif_rx_front_ring rx;
     grant_ref_t tx_ring_ref;
     grant_ref_t rx_ring_ref;
+    grant_ref_t gref_head;	/* reserved for rx and tx buffers */
     evtchn_port_t evtchn;
 
     char nodename[64];
@@ -58,6 +59,7 @@ struct netfront_dev {
 
 
     void (*netif_rx)(struct netfront_dev *, unsigned char* data, int len);
+    void (*netif_rx_notify)(struct netfront_dev *);
     void *netfront_priv;
 };
 
@@ -81,8 +83,17 @@ static inline int xennet_rxidx(RING_IDX idx)
     return idx & (NET_RX_RING_SIZE - 1);
 }
 
-void network_rx(struct netfront_dev *dev)
+/*
+ * Consume at most budget received packets, handing them to netif_rx,
+ * and refill the ring with the buffers they used.  If fewer than
+ * budget packets were consumed, the ring is drained and the backend
+ * will send an event when more arrive.  Otherwise the event is left
+ * unarmed and the caller is expected to poll again.
+ */
+int netfront_rxpoll(struct netfront_dev *dev, int budget)
 {
+    unsigned long frames[NET_RX_RING_SIZE];
+    grant_ref_t grefs[NET_RX_RING_SIZE];
     RING_IDX rp,cons,req_prod;
     int nr_consumed, more, i, notify;
 
@@ -91,7 +102,9 @@ moretodo:
     rp = dev->rx.sring->rsp_prod;
     rmb(); /* Ensure we see queued responses up to 'rp'. */
 
-    for (cons = dev->rx.rsp_cons; cons != rp; nr_consumed++, cons++)
+    for (cons = dev->rx.rsp_cons;
+      cons != rp && nr_consumed < budget;
+      nr_consumed++, cons++)
     {
         struct net_buffer* buf;
         unsigned char* page;
@@ -104,7 +117,7 @@ moretodo:
 
         buf = &dev->rx_buffers[id];
         page = (unsigned char*)buf->page;
-        gnttab_end_access(buf->gref);
+        gnttab_end_access_batch(&dev->gref_head, &buf->gref, 1);
 
         if (rx->status > NETIF_RSP_NULL)
         {
@@ -113,22 +126,27 @@ moretodo:
     }
     dev->rx.rsp_cons=cons;
 
-    RING_FINAL_CHECK_FOR_RESPONSES(&dev->rx,more);
-    if(more) goto moretodo;
+    if (nr_consumed < budget) {
+        RING_FINAL_CHECK_FOR_RESPONSES(&dev->rx,more);
+        if(more) goto moretodo;
+    }
 
     req_prod = dev->rx.req_prod_pvt;
 
+    for(i=0; i<nr_consumed; i++)
+        frames[i] = virt_to_mfn(dev->rx_buffers[xennet_rxidx(req_prod + i)].page);
+
+    /* We are sure to have reserved entries since they got released above */
+    gnttab_grant_access_batch(&dev->gref_head, dev->dom, frames, nr_consumed,
+        0, grefs);
+
     for(i=0; i<nr_consumed; i++)
     {
         int id = xennet_rxidx(req_prod + i);
         netif_rx_request_t *req = RING_GET_REQUEST(&dev->rx, req_prod + i);
         struct net_buffer* buf = &dev->rx_buffers[id];
-        void* page = buf->page;
-
-        /* We are sure to have free gnttab entries since they got released above */
-        buf->gref = req->gref = 
-            gnttab_grant_access(dev->dom,virt_to_mfn(page),0);
 
+        buf->gref = req->gref = grefs[i];
         req->id = id;
     }
 
@@ -140,6 +158,13 @@ moretodo:
     if (notify)
         minios_notify_remote_via_evtchn(dev->evtchn);
 
+    return nr_consumed;
+}
+
+void network_rx(struct netfront_dev *dev)
+{
+
+    netfront_rxpoll(dev, NET_RX_RING_SIZE);
 }
 
 void network_tx_buf_gc(struct netfront_dev *dev)
@@ -168,7 +193,7 @@ void network_tx_buf_gc(struct netfront_dev *dev)
             id  = txrsp->id;
             BUG_ON(id >= NET_TX_RING_SIZE);
             buf = &dev->tx_buffers[id];
-            gnttab_end_access(buf->gref);
+            gnttab_end_access_batch(&dev->gref_head, &buf->gref, 1);
             buf->gref=GRANT_INVALID_REF;
 
 	    add_id_to_freelist(id,dev->tx_freelist);
@@ -201,7 +226,12 @@ void netfront_handler(evtchn_port_t port, struct pt_regs *regs, void *data)
     local_irq_save(flags);
 
     network_tx_buf_gc(dev);
-    network_rx(dev);
+    if (dev->netif_rx_notify) {
+        if (RING_HAS_UNCONSUMED_RESPONSES(&dev->rx))
+            dev->netif_rx_notify(dev);
+    } else {
+        network_rx(dev);
+    }
 
     local_irq_restore(flags);
 }
@@ -228,9 +258,10 @@ static void free_netfront(struct netfront_dev *dev)
     minios_unbind_evtchn(dev->evtchn);
 
     for(i=0;i<NET_RX_RING_SIZE;i++) {
-	gnttab_end_access(dev->rx_buffers[i].gref);
+	gnttab_end_access_batch(&dev->gref_head, &dev->rx_buffers[i].gref, 1);
 	bmk_pgfree_one(dev->rx_buffers[i].page);
     }
+    gnttab_free_grant_references(dev->gref_head);
 
     for(i=0;i<NET_TX_RING_SIZE;i++)
 	if (dev->tx_buffers[i].page)
@@ -240,6 +271,18 @@ static void free_netfront(struct netfront_dev *dev)
 }
 
 struct netfront_dev *netfront_init(char *_nodename, void (*thenetif_rx)(struct netfront_dev *, unsigned char* data, int len), unsigned char rawmac[6], char **ip, void *priv)
+{
+
+    return netfront_init_rxpoll(_nodename, thenetif_rx, NULL, rawmac, ip, priv);
+}
+
+/*
+ * Like netfront_init(), but if netif_rx_notify is given, received
+ * packets are not processed from the event handler.  Instead,
+ * netif_rx_notify is called there, and the owner of the device
+ * collects the packets with netfront_rxpoll() from thread context.
+ */
+struct netfront_dev *netfront_init_rxpoll(char *_nodename, void (*thenetif_rx)(struct netfront_dev *, unsigned char* data, int len), void (*thenetif_rx_notify)(struct netfront_dev *), unsigned char rawmac[6], char **ip, void *priv)
 {
     xenbus_transaction_t xbt;
     char* err;
@@ -296,9 +339,15 @@ struct netfront_dev *netfront_init(char *_nodename, void (*thenetif_rx)(struct n
     dev->tx_ring_ref = gnttab_grant_access(dev->dom,virt_to_mfn(txs),0);
     dev->rx_ring_ref = gnttab_grant_access(dev->dom,virt_to_mfn(rxs),0);
 
+    /* one grant per buffer, so rx refill never waits for a grant */
+    if (gnttab_alloc_grant_references(NET_RX_RING_SIZE + NET_TX_RING_SIZE,
+      &dev->gref_head) != 0)
+        BUG();
+
     init_rx_buffers(dev);
 
     dev->netif_rx = thenetif_rx;
+    dev->netif_rx_notify = thenetif_rx_notify;
 
     xenbus_event_queue_init(&dev->events);
 
@@ -400,6 +449,8 @@ done:
         }
     }
 
+    /* let packets preempt xenstore and console events */
+    minios_evtchn_set_priority(dev->evtchn, MINIOS_EVTCHN_PRIO_HIGH);
     minios_unmask_evtchn(dev->evtchn);
 
     if (rawmac) {
@@ -492,18 +543,24 @@ close:
 
 void init_rx_buffers(struct netfront_dev *dev)
 {
+    unsigned long frames[NET_RX_RING_SIZE];
+    grant_ref_t grefs[NET_RX_RING_SIZE];
     int i, requeue_idx;
     netif_rx_request_t *req;
     int notify;
 
+    for (i = 0; i < NET_RX_RING_SIZE; i++)
+        frames[i] = virt_to_mfn(dev->rx_buffers[i].page);
+    gnttab_grant_access_batch(&dev->gref_head, dev->dom, frames,
+        NET_RX_RING_SIZE, 0, grefs);
+
     /* Rebuild the RX buffer freelist and the RX ring itself. */
     for (requeue_idx = 0, i = 0; i < NET_RX_RING_SIZE; i++) 
     {
         struct net_buffer* buf = &dev->rx_buffers[requeue_idx];
         req = RING_GET_REQUEST(&dev->rx, requeue_idx);
 
-        buf->gref = req->gref = 
-            gnttab_grant_access(dev->dom,virt_to_mfn(buf->page),0);
+        buf->gref = req->gref = grefs[requeue_idx];
 
         req->id = requeue_idx;
 
@@ -529,6 +586,7 @@ void netfront_xmit(struct netfront_dev *dev, unsigned char* data,int len)
     int notify;
     unsigned short id;
     struct net_buffer* buf;
+    unsigned long mfn;
     void* page;
 
     BUG_ON(len > PAGE_SIZE);
@@ -549,8 +607,10 @@ void netfront_xmit(struct netfront_dev *dev, unsigned char* data,int len)
 
     bmk_memcpy(page,data,len);
 
-    buf->gref = 
-        tx->gref = gnttab_grant_access(dev->dom,virt_to_mfn(page),1);
+    mfn = virt_to_mfn(page);
+    gnttab_grant_access_batch(&dev->gref_head, dev->dom, &mfn, 1, 1,
+        &buf->gref);
+    tx->gref = buf->gref;
 
     tx->offset=0;
     tx->size = len;
@@ -432,6 +432,8 @@ void init_xenbus(void)
     err = minios_bind_evtchn(start_info.store_evtchn,
 		      xenbus_evtchn_handler,
               NULL);
+    minios_evtchn_set_priority(start_info.store_evtchn,
+      MINIOS_EVTCHN_PRIO_LOW);
     minios_unmask_evtchn(start_info.store_evtchn);
     minios_printk("xenbus initialised on irq %d mfn %#lx\n",
 	   err, start_info.store_mfn);
@@ -0,0 +1,436 @@
+/*
+ * Benchmark the sysproxy protocol against the server in this guest,
+ * using a client which talks to it over a local unix socket.
+ * Every round writes NBUF buffers into a pipe with writev() and reads
+ * them back with readv().  It is done first with one request per
+ * syscall, where every buffer costs a copyin round trip, and then
+ * as a single batched request with the buffers prefetched.
+ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+
+#include <err.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <rump/rump.h>
+
+#include <rumprun/tester.h>
+
+#define SPPATH "/sysproxy_test"
+
+#define NBUF 16
+#define BUFSZ 256
+#define NROUNDS 1000
+
+/* protocol definitions, must match lib/librumprun_base/sysproxy.c */
+enum { RUMPSP_REQ, RUMPSP_RESP, RUMPSP_ERROR };
+enum {	RUMPSP_HANDSHAKE,
+	RUMPSP_SYSCALL,
+	RUMPSP_COPYIN, RUMPSP_COPYINSTR,
+	RUMPSP_COPYOUT, RUMPSP_COPYOUTSTR,
+	RUMPSP_ANONMMAP,
+	RUMPSP_PREFORK,
+	RUMPSP_RAISE,
+	RUMPSP_SYSCALLV };
+enum { HANDSHAKE_GUEST };
+
+struct rsp_hdr {
+	uint64_t rsp_len;
+	uint64_t rsp_reqno;
+	uint16_t rsp_class;
+	uint16_t rsp_type;
+	uint32_t rsp_arg;
+};
+#define HDRSZ sizeof(struct rsp_hdr)
+
+struct rsp_copydata {
+	size_t rcp_len;
+	void *rcp_addr;
+};
+
+struct rsp_sysresp {
+	int rsys_error;
+	register_t rsys_retval[2];
+};
+
+struct rsp_batchhdr {
+	uint32_t rbh_nsys;
+	uint32_t rbh_nprefetch;
+};
+
+struct rsp_batchsys {
+	uint32_t rbs_sysnum;
+	uint32_t rbs_flags;
+	uint64_t rbs_argslen;
+};
+#define RUMPSP_BATCH_STOPONERR	0x01
+#define RSP_ALIGN(x) (((x) + 7) & ~(size_t)7)
+
+static int spfd;
+static uint64_t spreqno = 1;
+static unsigned long ncopyin, ncopyout;
+
+static char wbuf[NBUF][BUFSZ], rbuf[NBUF][BUFSZ];
+static struct iovec wiov[NBUF], riov[NBUF];
+static int pfd[2];
+
+static uint64_t batchbuf[(NBUF*BUFSZ + 4096) / sizeof(uint64_t)];
+static size_t batchoff;
+
+static void
+xwritev(struct iovec *iov, int iovcnt)
+{
+	ssize_t n;
+
+	while (iovcnt > 0) {
+		if ((n = writev(spfd, iov, iovcnt)) <= 0)
+			err(1, "sysproxy write");
+		while (iovcnt > 0 && (size_t)n >= iov->iov_len) {
+			n -= iov->iov_len;
+			iov++;
+			iovcnt--;
+		}
+		if (iovcnt > 0) {
+			iov->iov_base = (char *)iov->iov_base + n;
+			iov->iov_len -= n;
+		}
+	}
+}
+
+static void
+xread(void *buf, size_t len)
+{
+	ssize_t n;
+
+	while (len > 0) {
+		if ((n = read(spfd, buf, len)) <= 0)
+			err(1, "sysproxy read");
+		buf = (char *)buf + n;
+		len -= n;
+	}
+}
+
+static void
+sendreq(struct rsp_hdr *hdr, void *data, size_t dlen)
+{
+	struct iovec iov[2];
+
+	iov[0].iov_base = hdr;
+	iov[0].iov_len = HDRSZ;
+	iov[1].iov_base = data;
+	iov[1].iov_len = dlen;
+	xwritev(iov, dlen ? 2 : 1);
+}
+
+/*
+ * Wait for the response to reqno, serving copy requests
+ * from the server while doing so.
+ */
+static size_t
+waitresp(uint64_t reqno, void *resp, size_t resplen)
+{
+	struct rsp_hdr hdr;
+	struct rsp_copydata rcp;
+	size_t dlen;
+
+	for (;;) {
+		xread(&hdr, sizeof(hdr));
+		dlen = hdr.rsp_len - HDRSZ;
+		if (hdr.rsp_class == RUMPSP_ERROR)
+			errx(1, "server error %u", hdr.rsp_arg);
+		if (hdr.rsp_class == RUMPSP_RESP) {
+			if (hdr.rsp_reqno != reqno || dlen > resplen)
+				errx(1, "unexpected response");
+			xread(resp, dlen);
+			return dlen;
+		}
+
+		xread(&rcp, sizeof(rcp));
+		switch (hdr.rsp_type) {
+		case RUMPSP_COPYIN:
+		case RUMPSP_COPYINSTR:
+			if (hdr.rsp_type == RUMPSP_COPYINSTR)
+				rcp.rcp_len = strnlen(rcp.rcp_addr,
+				    rcp.rcp_len - 1) + 1;
+			hdr.rsp_len = HDRSZ + rcp.rcp_len;
+			hdr.rsp_class = RUMPSP_RESP;
+			sendreq(&hdr, rcp.rcp_addr, rcp.rcp_len);
+			ncopyin++;
+			break;
+		case RUMPSP_COPYOUT:
+			xread(rcp.rcp_addr, rcp.rcp_len);
+			ncopyout++;
+			break;
+		default:
+			errx(1, "unexpected request %u", hdr.rsp_type);
+		}
+	}
+}
+
+static int
+spsyscall(int sysnum, register_t *args, size_t nargs, register_t *retval)
+{
+	struct rsp_hdr hdr;
+	struct rsp_sysresp resp;
+
+	hdr.rsp_len = HDRSZ + nargs*sizeof(*args);
+	hdr.rsp_reqno = spreqno++;
+	hdr.rsp_class = RUMPSP_REQ;
+	hdr.rsp_type = RUMPSP_SYSCALL;
+	hdr.rsp_arg = sysnum;
+	sendreq(&hdr, args, nargs*sizeof(*args));
+
+	if (waitresp(hdr.rsp_reqno, &resp, sizeof(resp)) != sizeof(resp))
+		errx(1, "short syscall response");
+	retval[0] = resp.rsys_retval[0];
+	retval[1] = resp.rsys_retval[1];
+	return resp.rsys_error;
+}
+
+static void
+batch_start(void)
+{
+
+	memset(batchbuf, 0, sizeof(struct rsp_batchhdr));
+	batchoff = sizeof(struct rsp_batchhdr);
+}
+
+static void
+batch_add(void *item, size_t itemlen, const void *data, size_t dlen)
+{
+	uint8_t *p = (uint8_t *)batchbuf + batchoff;
+
+	if (batchoff + RSP_ALIGN(itemlen + dlen) > sizeof(batchbuf))
+		errx(1, "batch too large");
+	memcpy(p, item, itemlen);
+	memcpy(p + itemlen, data, dlen);
+	batchoff += RSP_ALIGN(itemlen + dlen);
+}
+
+static void
+batch_syscall(int sysnum, register_t *args, size_t nargs)
+{
+	struct rsp_batchhdr *rbh = (void *)batchbuf;
+	struct rsp_batchsys rbs;
+
+	/* syscalls come before prefetched data */
+	if (rbh->rbh_nprefetch)
+		errx(1, "syscall after prefetch");
+
+	rbs.rbs_sysnum = sysnum;
+	rbs.rbs_flags = RUMPSP_BATCH_STOPONERR;
+	rbs.rbs_argslen = nargs*sizeof(*args);
+	batch_add(&rbs, sizeof(rbs), args, nargs*sizeof(*args));
+	rbh->rbh_nsys++;
+}
+
+static void
+batch_prefetch(void *addr, size_t len)
+{
+	struct rsp_batchhdr *rbh = (void *)batchbuf;
+	struct rsp_copydata rcp;
+
+	rcp.rcp_addr = addr;
+	rcp.rcp_len = len;
+	batch_add(&rcp, sizeof(rcp), addr, len);
+	rbh->rbh_nprefetch++;
+}
+
+static size_t
+batch_run(struct rsp_sysresp *resp, size_t nresp)
+{
+	struct rsp_hdr hdr;
+
+	hdr.rsp_len = HDRSZ + batchoff;
+	hdr.rsp_reqno = spreqno++;
+	hdr.rsp_class = RUMPSP_REQ;
+	hdr.rsp_type = RUMPSP_SYSCALLV;
+	hdr.rsp_arg = 0;
+	sendreq(&hdr, batchbuf, batchoff);
+
+	return waitresp(hdr.rsp_reqno, resp, nresp*sizeof(*resp))
+	    / sizeof(*resp);
+}
+
+static void
+spconnect(void)
+{
+	struct sockaddr_un sun;
+	struct rsp_hdr hdr;
+	char banner[128], comm[] = "sysproxy_test";
+	int major, minor, error;
+	size_t i;
+
+	if ((spfd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1)
+		err(1, "socket");
+	memset(&sun, 0, sizeof(sun));
+	sun.sun_family = AF_UNIX;
+	strlcpy(sun.sun_path, SPPATH, sizeof(sun.sun_path));
+	if (connect(spfd, (struct sockaddr *)&sun, sizeof(sun)) == -1)
+		err(1, "connect");
+
+	for (i = 0; i < sizeof(banner)-1; i++) {
+		xread(&banner[i], 1);
+		if (banner[i] == '\n')
+			break;
+	}
+	banner[i] = '\0';
+	if (sscanf(banner, "RUMPSP-%d.%d", &major, &minor) != 2
+	    || major != 0 || minor < 5)
+		errx(1, "unsupported server \"%s\"", banner);
+
+	hdr.rsp_len = HDRSZ + sizeof(comm);
+	hdr.rsp_reqno = spreqno++;
+	hdr.rsp_class = RUMPSP_REQ;
+	hdr.rsp_type = RUMPSP_HANDSHAKE;
+	hdr.rsp_arg = HANDSHAKE_GUEST;
+	sendreq(&hdr, comm, sizeof(comm));
+	if (waitresp(hdr.rsp_reqno, &error, sizeof(error)) != sizeof(error)
+	    || error != 0)
+		errx(1, "handshake failed");
+}
+
+static void
+fillbufs(int round)
+{
+	int i;
+
+	for (i = 0; i < NBUF; i++)
+		memset(wbuf[i], 'a' + (round + i) % 26, BUFSZ);
+	memset(rbuf, 0, sizeof(rbuf));
+}
+
+static int
+checkbufs(void)
+{
+
+	if (memcmp(wbuf, rbuf, sizeof(wbuf)) != 0) {
+		printf("data mismatch\n");
+		return 1;
+	}
+	return 0;
+}
+
+static double
+elapsed(struct timespec *ts0)
+{
+	struct timespec ts1;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts1);
+	return (ts1.tv_sec - ts0->tv_sec)
+	    + (ts1.tv_nsec - ts0->tv_nsec) / 1000000000.0;
+}
+
+static int
+bench_single(void)
+{
+	register_t wargs[3], rargs[3], retval[2];
+	struct timespec ts;
+	int round;
+
+	wargs[0] = pfd[1];
+	wargs[1] = (register_t)wiov;
+	wargs[2] = NBUF;
+	rargs[0] = pfd[0];
+	rargs[1] = (register_t)riov;
+	rargs[2] = NBUF;
+
+	ncopyin = ncopyout = 0;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	for (round = 0; round < NROUNDS; round++) {
+		fillbufs(round);
+		if (spsyscall(SYS_writev, wargs, 3, retval) != 0
+		    || retval[0] != NBUF*BUFSZ)
+			errx(1, "writev failed");
+		if (spsyscall(SYS_readv, rargs, 3, retval) != 0
+		    || retval[0] != NBUF*BUFSZ)
+			errx(1, "readv failed");
+		if (checkbufs())
+			return 1;
+	}
+	printf("single:  %d rounds in %.3fs, %lu copyin, %lu copyout requests\n",
+	    NROUNDS, elapsed(&ts), ncopyin, ncopyout);
+
+	return 0;
+}
+
+static int
+bench_batch(void)
+{
+	struct rsp_sysresp resp[2];
+	register_t wargs[3], rargs[3];
+	struct timespec ts;
+	int round, i;
+
+	wargs[0] = pfd[1];
+	wargs[1] = (register_t)wiov;
+	wargs[2] = NBUF;
+	rargs[0] = pfd[0];
+	rargs[1] = (register_t)riov;
+	rargs[2] = NBUF;
+
+	ncopyin = ncopyout = 0;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	for (round = 0; round < NROUNDS; round++) {
+		fillbufs(round);
+		batch_start();
+		batch_syscall(SYS_writev, wargs, 3);
+		batch_syscall(SYS_readv, rargs, 3);
+		batch_prefetch(wiov, sizeof(wiov));
+		batch_prefetch(riov, sizeof(riov));
+		for (i = 0; i < NBUF; i++)
+			batch_prefetch(wbuf[i], BUFSZ);
+		if (batch_run(resp, 2) != 2)
+			errx(1, "short batch response");
+		for (i = 0; i < 2; i++) {
+			if (resp[i].rsys_error != 0
+			    || resp[i].rsys_retval[0] != NBUF*BUFSZ)
+				errx(1, "batched syscall %d failed", i);
+		}
+		if (checkbufs())
+			return 1;
+	}
+	printf("batched: %d rounds in %.3fs, %lu copyin, %lu copyout requests\n",
+	    NROUNDS, elapsed(&ts), ncopyin, ncopyout);
+
+	/* everything was prefetched */
+	return ncopyin != 0;
+}
+
+int
+rumprun_test(int argc, char *argv[])
+{
+	register_t args[2], retval[2];
+	int i, rv;
+
+	if ((rv = rump_init_server("unix://" SPPATH)) != 0) {
+		printf("sysproxy init failed: %d\n", rv);
+		return 1;
+	}
+	spconnect();
+
+	args[0] = (register_t)pfd;
+	args[1] = 0;
+	if (spsyscall(SYS_pipe2, args, 2, retval) != 0)
+		errx(1, "pipe2 failed");
+
+	for (i = 0; i < NBUF; i++) {
+		wiov[i].iov_base = wbuf[i];
+		wiov[i].iov_len = BUFSZ;
+		riov[i].iov_base = rbuf[i];
+		riov[i].iov_len = BUFSZ;
+	}
+
+	if ((rv = bench_single()) != 0)
+		return rv;
+	return bench_batch();
+}
@@ -1,5 +1,6 @@
 #include <bmk-core/errno.h>
 #include <bmk-core/mainthread.h>
+#include <bmk-core/platform.h>
 #include <bmk-core/printf.h>
 #include <bmk-core/string.h>
 
@@ -19,6 +20,17 @@ bmk_mainthread(void *cmdline)
 {
 	int rv, fd;
 
+	if (strcheck() != 0)
+		bmk_platform_halt("string routines returned wrong results");
+#ifdef NOLIBC_STRBENCH
+	strbench();
+#endif
+	if (thrcheck() != 0)
+		bmk_platform_halt("threads were not run or reused correctly");
+#ifdef NOLIBC_THRBENCH
+	thrbench();
+#endif
+
 	rv = rump_init();
 	bmk_printf("rump kernel init complete, rv %d\n", rv);
 
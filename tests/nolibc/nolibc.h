@@ -25,6 +25,11 @@ typedef int		uid_t;
 typedef unsigned int	u_int;
 typedef unsigned long	u_long;
 
+int strcheck(void);
+void strbench(void);
+int thrcheck(void);
+void thrbench(void);
+
 struct timespec;
 struct itimerspec;
 struct sigevent;
@@ -0,0 +1,203 @@
+/*
+ * Correctness and throughput of the bmk string routines over a range
+ * of sizes.  The checks run every combination of source and
+ * destination misalignment, the benchmark offsets its buffers by a
+ * few bytes from the start of a page so that the unaligned head and
+ * tail are exercised too.
+ */
+
+#include <bmk-core/core.h>
+#include <bmk-core/null.h>
+#include <bmk-core/pgalloc.h>
+#include <bmk-core/platform.h>
+#include <bmk-core/printf.h>
+#include <bmk-core/string.h>
+
+#include "nolibc.h"
+
+#define BUFORDER 4	/* 64k with 4k pages */
+#define BUFSIZE (1UL<<(BUFORDER+BMK_PCPU_PAGE_SHIFT))
+#define TOTAL (32*1024*1024UL)
+
+#define MAXOFF 8	/* misalignments checked, at least a word */
+#define GUARD 16	/* bytes checked on each side of the result */
+
+static const unsigned long sizes[] = { 16, 64, 256, 1024, 4096, 16384, 60000 };
+
+static int
+checkbuf(const char *what, const unsigned char *buf, unsigned long off,
+	unsigned long n, const unsigned char *want, int fill)
+{
+	unsigned long i;
+
+	for (i = 0; i < n; i++) {
+		if (buf[off+i] != (want ? want[i] : (unsigned char)fill)) {
+			bmk_printf("strcheck: %s off %lu len %lu: "
+			    "byte %lu wrong\n", what, off, n, i);
+			return 1;
+		}
+	}
+	for (i = off < GUARD ? 0 : off - GUARD; i < off; i++) {
+		if (buf[i] != 0xee) {
+			bmk_printf("strcheck: %s off %lu len %lu: "
+			    "wrote before start\n", what, off, n);
+			return 1;
+		}
+	}
+	for (i = off+n; i < off+n+GUARD; i++) {
+		if (buf[i] != 0xee) {
+			bmk_printf("strcheck: %s off %lu len %lu: "
+			    "wrote past end\n", what, off, n);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static int
+checklen(unsigned char *src, unsigned char *dst,
+	unsigned long soff, unsigned long doff, unsigned long n)
+{
+	unsigned long i, lim = MAXOFF + n + GUARD;
+	int errs = 0;
+
+	for (i = 0; i < lim; i++)
+		src[i] = (unsigned char)(i*7 + 1);
+
+	bmk_memset(dst, 0xee, lim);
+	if (bmk_memcpy(dst+doff, src+soff, n) != dst+doff) {
+		bmk_printf("strcheck: memcpy return value\n");
+		errs++;
+	}
+	errs += checkbuf("memcpy", dst, doff, n, src+soff, 0);
+
+	bmk_memset(dst, 0xee, lim);
+	if (bmk_memset(dst+doff, 0x5a, n) != dst+doff) {
+		bmk_printf("strcheck: memset return value\n");
+		errs++;
+	}
+	errs += checkbuf("memset", dst, doff, n, NULL, 0x5a);
+
+	/*
+	 * memchr must find a needle in the last byte, and not one
+	 * just past the end.  Use a value with the top bit set, to
+	 * check that the argument is handled as unsigned char.
+	 */
+	bmk_memset(src, 'a', lim);
+	if (n > 0) {
+		src[soff+n-1] = 0xb0;
+		if (bmk_memchr(src+soff, 0xb0, n) != src+soff+n-1) {
+			bmk_printf("strcheck: memchr off %lu len %lu: "
+			    "needle at end not found\n", soff, n);
+			errs++;
+		}
+		src[soff+n-1] = 'a';
+	}
+	src[soff+n] = 0xb0;
+	if (bmk_memchr(src+soff, 0xb0, n) != NULL) {
+		bmk_printf("strcheck: memchr off %lu len %lu: "
+		    "found needle past end\n", soff, n);
+		errs++;
+	}
+
+	src[soff+n] = '\0';
+	if (bmk_strlen((char *)src+soff) != n) {
+		bmk_printf("strcheck: strlen off %lu len %lu: got %lu\n",
+		    soff, n, bmk_strlen((char *)src+soff));
+		errs++;
+	}
+
+	return errs;
+}
+
+/*
+ * Check the results of the routines, returns the number of errors.
+ * All lengths up to a few words are checked, since those are what
+ * the head and tail handling deals with.
+ */
+int
+strcheck(void)
+{
+	unsigned char *src, *dst;
+	unsigned long soff, doff, n;
+	unsigned s;
+	int errs = 0;
+
+	src = bmk_pgalloc(BUFORDER);
+	dst = bmk_pgalloc(BUFORDER);
+	if (!src || !dst) {
+		bmk_printf("strcheck: out of memory\n");
+		return 1;
+	}
+
+	for (soff = 0; soff < MAXOFF; soff++) {
+		for (doff = 0; doff < MAXOFF; doff++) {
+			for (n = 0; n <= 4*MAXOFF; n++)
+				errs += checklen(src, dst, soff, doff, n);
+			for (s = 0; s < sizeof(sizes)/sizeof(sizes[0]); s++)
+				errs += checklen(src, dst,
+				    soff, doff, sizes[s]);
+		}
+	}
+
+	bmk_pgfree(src, BUFORDER);
+	bmk_pgfree(dst, BUFORDER);
+
+	return errs;
+}
+
+static unsigned long
+mbps(unsigned long bytes, bmk_time_t ns)
+{
+
+	if (ns == 0)
+		ns = 1;
+	return (bytes * 1000) / ns;
+}
+
+void
+strbench(void)
+{
+	char *src, *dst;
+	bmk_time_t start, tcpy, tset, tchr;
+	unsigned long i, n, iters;
+	unsigned s;
+
+	src = bmk_pgalloc(BUFORDER);
+	dst = bmk_pgalloc(BUFORDER);
+	if (!src || !dst) {
+		bmk_printf("strbench: out of memory\n");
+		return;
+	}
+	bmk_memset(src, 'a', BUFSIZE);
+
+	bmk_printf("%8s %12s %12s %12s\n",
+	    "size", "memcpy MB/s", "memset MB/s", "memchr MB/s");
+	for (s = 0; s < sizeof(sizes)/sizeof(sizes[0]); s++) {
+		n = sizes[s];
+		iters = TOTAL / n;
+
+		start = bmk_platform_cpu_clock_monotonic();
+		for (i = 0; i < iters; i++)
+			bmk_memcpy(dst + 3, src + 3, n);
+		tcpy = bmk_platform_cpu_clock_monotonic() - start;
+
+		start = bmk_platform_cpu_clock_monotonic();
+		for (i = 0; i < iters; i++)
+			bmk_memset(dst + 3, (int)i, n);
+		tset = bmk_platform_cpu_clock_monotonic() - start;
+
+		start = bmk_platform_cpu_clock_monotonic();
+		for (i = 0; i < iters; i++)
+			if (bmk_memchr(src + 3, 'b', n) != NULL)
+				bmk_printf("strbench: memchr false positive\n");
+		tchr = bmk_platform_cpu_clock_monotonic() - start;
+
+		bmk_printf("%8lu %12lu %12lu %12lu\n", n,
+		    mbps(iters*n, tcpy), mbps(iters*n, tset),
+		    mbps(iters*n, tchr));
+	}
+
+	bmk_pgfree(src, BUFORDER);
+	bmk_pgfree(dst, BUFORDER);
+}
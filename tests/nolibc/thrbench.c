@@ -0,0 +1,113 @@
+/*
+ * Thread creation and exit: a check that threads run and are joined
+ * and that exited threads are reused, and latency.  Each round of the
+ * benchmark creates a joinable thread which exits right away, and
+ * joins it.  The first rounds populate the scheduler's stack and tls
+ * caches, the rest should not need to allocate anything.
+ */
+
+#include <bmk-core/null.h>
+#include <bmk-core/platform.h>
+#include <bmk-core/printf.h>
+#include <bmk-core/sched.h>
+
+#include "nolibc.h"
+
+#define ROUNDS 10000
+#define NCHECK 40	/* more than the scheduler caches */
+
+static bmk_time_t created;
+static bmk_time_t tostart;
+
+static void
+thrfun(void *arg)
+{
+
+	tostart += bmk_platform_cpu_clock_monotonic() - created;
+}
+
+static int ran[NCHECK];
+
+static void
+checkfun(void *arg)
+{
+
+	ran[(int *)arg - ran]++;
+}
+
+/*
+ * Returns the number of errors.
+ */
+int
+thrcheck(void)
+{
+	struct bmk_thread *thr[NCHECK], *prev;
+	int i, errs = 0;
+
+	for (i = 0; i < NCHECK; i++) {
+		thr[i] = bmk_sched_create("check", NULL, 1, checkfun, &ran[i],
+		    NULL, 0);
+		if (thr[i] == NULL) {
+			bmk_printf("thrcheck: cannot create thread %d\n", i);
+			return errs + 1;
+		}
+	}
+	for (i = 0; i < NCHECK; i++) {
+		bmk_sched_join(thr[i]);
+		if (ran[i] != 1) {
+			bmk_printf("thrcheck: thread %d ran %d times\n",
+			    i, ran[i]);
+			errs++;
+		}
+	}
+
+	/*
+	 * A joined thread is reaped once it has switched away for the
+	 * last time, after which its structure is the first one that
+	 * the next create takes from the cache.
+	 */
+	ran[0] = 0;
+	prev = bmk_sched_create("check", NULL, 1, checkfun, &ran[0], NULL, 0);
+	bmk_sched_join(prev);
+	bmk_sched_yield();
+	thr[0] = bmk_sched_create("check", NULL, 1, checkfun, &ran[0],
+	    NULL, 0);
+	bmk_sched_join(thr[0]);
+	if (thr[0] != prev) {
+		bmk_printf("thrcheck: exited thread not reused\n");
+		errs++;
+	}
+	if (ran[0] != 2) {
+		bmk_printf("thrcheck: reused thread did not run\n");
+		errs++;
+	}
+
+	return errs;
+}
+
+void
+thrbench(void)
+{
+	struct bmk_thread *thr;
+	bmk_time_t start, tcreate, tjoin, t;
+	int i;
+
+	tcreate = tjoin = tostart = 0;
+	for (i = 0; i < ROUNDS; i++) {
+		start = bmk_platform_cpu_clock_monotonic();
+		thr = bmk_sched_create("bench", NULL, 1, thrfun, NULL,
+		    NULL, 0);
+		created = bmk_platform_cpu_clock_monotonic();
+		tcreate += created - start;
+
+		bmk_sched_join(thr);
+		t = bmk_platform_cpu_clock_monotonic();
+		tjoin += t - created;
+	}
+
+	bmk_printf("thread create: %lu ns, create to run: %lu ns, "
+	    "create to joined: %lu ns (avg of %d)\n",
+	    (unsigned long)(tcreate / ROUNDS),
+	    (unsigned long)(tostart / ROUNDS),
+	    (unsigned long)(tjoin / ROUNDS), ROUNDS);
+}
@@ -34,7 +34,7 @@ export RUMPRUN_WARNING_STFU=please
 
 # TODO: use a more scalable way of specifying tests
 TESTS='hello/hello.bin basic/ctor_test.bin basic/pthread_test.bin
-	basic/tls_test.bin basic/misc_test.bin'
+	basic/tls_test.bin basic/misc_test.bin basic/sysproxy_test.bin'
 [ -x hello/hellopp.bin ] && TESTS="${TESTS} hello/hellopp.bin"
 
 STARTMAGIC='=== FOE RUMPRUN 12345 TES-TER 54321 ==='